@@ -0,0 +1,295 @@
+// Microbenchmarks of the buffer manager, one line of results per case and
+// pool size:
+//   hash_insert, hash_lookup, hash_remove - BufHashTbl with frames entries
+//   read_hit        - readPage() and unPinPage() of a page in the pool
+//   read_miss_clean - the same for pages not in the pool, replacing clean ones
+//   read_miss_dirty - ... replacing dirty ones, which are written back first
+//   alloc_page      - allocPage() and unPinPage()
+//   alloc_pages     - allocPages() of 64 pages and unPinPages(), per page
+//   flush_file      - flushFile() of a pool full of dirty pages, per page
+//   page_insert     - Page::insertRecord() of small records until the page is full
+//   page_delete     - Page::deleteRecord() of them, oldest first
+// The page cases use no pool and report 0 frames.
+//
+// The output is tab separated, a header line and then
+//   case  frames  ops  ns_per_op  ops_per_s
+// for every case and pool size; lines starting with # are comments.
+//
+// usage: bench [millisPerCase [frames ...]]
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include "page.h"
+#include "buf.h"
+
+BufMgr*     bufMgr;
+
+static const char* NAME = "bench.db";
+
+static int millis = 200;
+
+// allocPage() grows the file; never more than this many pages per run
+static const int MAXALLOC = 65536;
+
+static uint64_t nanos()
+{
+  return chrono::duration_cast<chrono::nanoseconds>
+    (chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* name, const int frames, const long ops,
+		   const uint64_t ns)
+{
+  double perOp = ops ? (double) ns / ops : 0;
+  cout << name << "\t" << frames << "\t" << ops << "\t" << fixed
+       << setprecision(1) << perOp << "\t" << (long) (ns ? ops * 1e9 / ns : 0)
+       << endl;
+}
+
+static void check(const Status status)
+{
+  if (status != OK) {
+    Error().print(status);
+    exit(1);
+  }
+}
+
+static void benchHash(const int frames)
+{
+  BufHashTbl table(frames);
+  vector<PageId> keys(frames);
+  for (int i = 0; i < frames; i++)
+    keys[i] = ((PageId) (1 + i % 4) << 32) | (1 + i / 4);
+  uint64_t inserting = 0, removing = 0, looking = 0;
+  long inserts = 0, removes = 0, lookups = 0;
+  unsigned int state = 1;
+  long sum = 0;
+  while (inserting + removing + looking < (uint64_t) millis * 1000000) {
+    uint64_t t0 = nanos();
+    for (int i = 0; i < frames; i++)
+      table.insert(keys[i], i);
+    uint64_t t1 = nanos();
+    for (int i = 0; i < frames; i++) {
+      state = state * 1103515245 + 12345;
+      int frame = -1;
+      table.lookup(keys[(state >> 8) % frames], frame);
+      sum += frame;
+    }
+    uint64_t t2 = nanos();
+    for (int i = 0; i < frames; i++)
+      table.remove(keys[i]);
+    uint64_t t3 = nanos();
+    inserting += t1 - t0;
+    looking += t2 - t1;
+    removing += t3 - t2;
+    inserts += frames;
+    lookups += frames;
+    removes += frames;
+  }
+  report("hash_insert", frames, inserts, inserting);
+  report("hash_lookup", frames, lookups + (sum == 42), looking);
+  report("hash_remove", frames, removes, removing);
+}
+
+// a file of pages pages, none of them in the pool
+static File* makeFile(DB& db, const int pages)
+{
+  File* file;
+  if (access(NAME, F_OK) == 0)
+    (void)db.destroyFile(NAME);
+  check(db.createFile(NAME));
+  check(db.openFile(NAME, file));
+  Page* page;
+  int pageNo;
+  for (int p = 0; p < pages; p++) {
+    check(bufMgr->allocPage(file, pageNo, page));
+    check(bufMgr->unPinPage(file, pageNo, true));
+  }
+  check(bufMgr->flushFile(file));
+  return file;
+}
+
+static void closeFile(DB& db, File* file)
+{
+  check(db.closeFile(file));
+  check(db.destroyFile(NAME));
+}
+
+// readPage() and unPinPage() of pages pages chosen at random, or in turn;
+// with more pages than frames in turn every read misses
+static void benchRead(DB& db, const char* name, const int frames,
+		      const int pages, const bool random, const bool dirty)
+{
+  bufMgr = new BufMgr(frames);
+  File* file = makeFile(db, pages);
+  Page* page;
+  // fill the pool, and dirty it if the victims are to be dirty
+  for (int p = 1; p <= min(frames, pages); p++) {
+    check(bufMgr->readPage(file, p, page));
+    check(bufMgr->unPinPage(file, p, dirty));
+  }
+  unsigned int state = 1;
+  int next = min(frames, pages);
+  long ops = 0;
+  uint64_t start = nanos(), elapsed = 0;
+  while (elapsed < (uint64_t) millis * 1000000) {
+    for (int k = 0; k < 64; k++) {
+      int pageNo;
+      if (random) {
+	state = state * 1103515245 + 12345;
+	pageNo = 1 + (state >> 8) % pages;
+      } else {
+	pageNo = 1 + next++ % pages;
+      }
+      check(bufMgr->readPage(file, pageNo, page));
+      check(bufMgr->unPinPage(file, pageNo, dirty));
+    }
+    ops += 64;
+    elapsed = nanos() - start;
+  }
+  report(name, frames, ops, elapsed);
+  closeFile(db, file);
+  delete bufMgr;
+}
+
+static void benchAlloc(DB& db, const int frames)
+{
+  bufMgr = new BufMgr(frames);
+  File* file = makeFile(db, 0);
+  Page* page;
+  int pageNo;
+  long ops = 0;
+  uint64_t start = nanos(), elapsed = 0;
+  while (elapsed < (uint64_t) millis * 1000000 && ops < MAXALLOC) {
+    for (int k = 0; k < 64; k++) {
+      check(bufMgr->allocPage(file, pageNo, page));
+      check(bufMgr->unPinPage(file, pageNo, true));
+    }
+    ops += 64;
+    elapsed = nanos() - start;
+  }
+  report("alloc_page", frames, ops, elapsed);
+  closeFile(db, file);
+  delete bufMgr;
+}
+
+static void benchAllocRun(DB& db, const int frames)
+{
+  bufMgr = new BufMgr(frames);
+  File* file = makeFile(db, 0);
+  const int n = min(frames, 64);
+  vector<Page*> pages(n);
+  vector<int> pageNos(n);
+  long ops = 0;
+  uint64_t start = nanos(), elapsed = 0;
+  while (elapsed < (uint64_t) millis * 1000000 && ops < MAXALLOC) {
+    int pageNo;
+    check(bufMgr->allocPages(file, n, pageNo, &pages[0]));
+    for (int k = 0; k < n; k++)
+      pageNos[k] = pageNo + k;
+    check(bufMgr->unPinPages(file, &pageNos[0], n, true));
+    ops += n;
+    elapsed = nanos() - start;
+  }
+  report("alloc_pages", frames, ops, elapsed);
+  closeFile(db, file);
+  delete bufMgr;
+}
+
+// flushFile() of a pool of dirty pages, as ns per page written
+static void benchFlush(DB& db, const int frames)
+{
+  bufMgr = new BufMgr(frames);
+  File* file = makeFile(db, frames);
+  Page* page;
+  long ops = 0;
+  uint64_t elapsed = 0;
+  while (elapsed < (uint64_t) millis * 1000000) {
+    for (int p = 1; p <= frames; p++) {
+      check(bufMgr->readPage(file, p, page));
+      check(bufMgr->unPinPage(file, p, true));
+    }
+    uint64_t start = nanos();
+    check(bufMgr->flushFile(file));
+    elapsed += nanos() - start;
+    ops += frames;
+  }
+  report("flush_file", frames, ops, elapsed);
+  closeFile(db, file);
+  delete bufMgr;
+}
+
+// filling a page with small records and emptying it again, oldest first
+static void benchRecords()
+{
+  static Page page;
+  char data[32];
+  memset(data, 'x', sizeof data);
+  Record rec = { data, sizeof data };
+  vector<RID> rids;
+  long inserts = 0, deletes = 0;
+  uint64_t inserting = 0, deleting = 0;
+  while (inserting + deleting < (uint64_t) millis * 1000000) {
+    for (int round = 0; round < 64; round++) {
+      page.init(1);
+      rids.clear();
+      RID rid;
+      uint64_t t0 = nanos();
+      while (page.insertRecord(rec, rid) == OK)
+	rids.push_back(rid);
+      uint64_t t1 = nanos();
+      for (size_t i = 0; i < rids.size(); i++)
+	check(page.deleteRecord(rids[i]));
+      uint64_t t2 = nanos();
+      inserting += t1 - t0;
+      deleting += t2 - t1;
+      inserts += rids.size();
+      deletes += rids.size();
+    }
+  }
+  report("page_insert", 0, inserts, inserting);
+  report("page_delete", 0, deletes, deleting);
+}
+
+int main(int argc, char** argv)
+{
+  if (argc > 1)
+    millis = atoi(argv[1]);
+  vector<int> sizes;
+  for (int i = 2; i < argc; i++)
+    sizes.push_back(atoi(argv[i]));
+  if (sizes.empty()) {
+    sizes.push_back(100);
+    sizes.push_back(1000);
+    sizes.push_back(10000);
+  }
+  bool usage = millis < 1;
+  for (size_t i = 0; i < sizes.size(); i++)
+    usage = usage || sizes[i] < 1;
+  if (usage) {
+    cerr << "usage: bench [millisPerCase [frames ...]]" << endl;
+    return 1;
+  }
+
+  DB db;
+  cout << "# millis=" << millis << " pagesize=" << PAGESIZE << endl;
+  cout << "case\tframes\tops\tns_per_op\tops_per_s" << endl;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    int frames = sizes[i];
+    benchHash(frames);
+    benchRead(db, "read_hit", frames, frames, true, false);
+    benchRead(db, "read_miss_clean", frames, 2 * frames, false, false);
+    benchRead(db, "read_miss_dirty", frames, 2 * frames, false, true);
+    benchAlloc(db, frames);
+    benchAllocRun(db, frames);
+    benchFlush(db, frames);
+  }
+  benchRecords();
+  return 0;
+}
@@ -0,0 +1,183 @@
+// Page table lookup throughput versus number of threads.
+//
+// Compares three ways of finding the frame of a buffered page:
+//   chained  - the old chained BufHashTbl (kept here for reference) behind
+//              one mutex, which is how callers had to serialize BufMgr
+//   latched  - BufHashTbl partitions, each behind a shared latch
+//   peek     - BufHashTbl::peek, no latch at all
+//
+// usage: benchHash [entries [maxThreads [millisPerRun]]]
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include "page.h"
+#include "buf.h"
+
+BufMgr*     bufMgr;
+
+// the chained hash table BufHashTbl used to be
+class ChainedHashTbl
+{
+private:
+  struct bucket
+  {
+    const File* file;
+    int pageNo;
+    int frameNo;
+    bucket* next;
+  };
+  int HTSIZE;
+  bucket** ht;
+  int hash(const File* file, const int pageNo)
+  {
+    unsigned int tmp, value;
+    tmp = (unsigned long)file;  // cast of pointer to the file object to an integer
+    value = (tmp + pageNo) % HTSIZE;
+    return value;
+  }
+
+public:
+  ChainedHashTbl(const int htSize) : HTSIZE(htSize)
+  {
+    ht = new bucket* [htSize];
+    for (int i = 0; i < HTSIZE; i++)
+      ht[i] = NULL;
+  }
+  ~ChainedHashTbl()
+  {
+    for (int i = 0; i < HTSIZE; i++)
+      while (ht[i]) {
+	bucket* tmpBuc = ht[i];
+	ht[i] = tmpBuc->next;
+	delete tmpBuc;
+      }
+    delete [] ht;
+  }
+  void insert(const File* file, const int pageNo, const int frameNo)
+  {
+    int index = hash(file, pageNo);
+    bucket* tmpBuc = new bucket;
+    tmpBuc->file = file;
+    tmpBuc->pageNo = pageNo;
+    tmpBuc->frameNo = frameNo;
+    tmpBuc->next = ht[index];
+    ht[index] = tmpBuc;
+  }
+  Status lookup(const File* file, const int pageNo, int& frameNo)
+  {
+    for (bucket* tmpBuc = ht[hash(file, pageNo)]; tmpBuc; tmpBuc = tmpBuc->next)
+      if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
+	frameNo = tmpBuc->frameNo;
+	return OK;
+      }
+    return HASHNOTFOUND;
+  }
+};
+
+static const int NUMFILES = 4;
+static const File* files[NUMFILES];
+
+static int entries = 100000;
+static int millis = 200;
+static atomic<bool> stop;
+
+static ChainedHashTbl* chained;
+static mutex chainedLatch;
+static BufPartition* parts;
+
+// lookups of random pages until stop is set; returns the number done
+static void lookups(int impl, int seed, long* done)
+{
+  unsigned int state = seed;
+  long n = 0;
+  long sum = 0;
+  while (!stop) {
+    for (int k = 0; k < 64; k++) {
+      state = state * 1103515245 + 12345;
+      int f = (state >> 8) % NUMFILES;
+      int pageNo = 1 + (state >> 12) % (entries / NUMFILES);
+      int frame = -1;
+      if (impl == 0) {
+	lock_guard<mutex> guard(chainedLatch);
+	chained->lookup(files[f], pageNo, frame);
+      } else {
+	PageId key = ((PageId) (f + 1) << 32) | pageNo;
+	BufPartition& part = parts[BufHashTbl::hash(key) % BUFPARTITIONS];
+	if (impl == 1) {
+	  part.latch.lock_shared();
+	  part.table->lookup(key, frame);
+	  part.latch.unlock_shared();
+	} else {
+	  part.table->peek(key, frame);
+	}
+      }
+      sum += frame;
+    }
+    n += 64;
+  }
+  *done = n + (sum == 42);  // keep the lookups from being optimized away
+}
+
+int main(int argc, char** argv)
+{
+  if (argc > 1)
+    entries = atoi(argv[1]);
+  int maxThreads = argc > 2 ? atoi(argv[2]) : 32;
+  if (argc > 3)
+    millis = atoi(argv[3]);
+  if (entries < NUMFILES || maxThreads < 1) {
+    cerr << "usage: benchHash [entries [maxThreads [millisPerRun]]]" << endl;
+    return 1;
+  }
+
+  // fake file objects; the chained table only uses their addresses, the
+  // others identify file f by id f + 1
+  static char fileObjs[NUMFILES][64];
+  for (int f = 0; f < NUMFILES; f++)
+    files[f] = (const File*) fileObjs[f];
+
+  chained = new ChainedHashTbl(((int) (entries * 1.2)) + 1);
+  parts = new BufPartition[BUFPARTITIONS];
+  for (int i = 0; i < BUFPARTITIONS; i++)
+    parts[i].table = new BufHashTbl(((int) (entries * 1.2)) / BUFPARTITIONS + 1);
+  int frame = 0;
+  for (int f = 0; f < NUMFILES; f++)
+    for (int p = 1; p <= entries / NUMFILES; p++, frame++) {
+      PageId key = ((PageId) (f + 1) << 32) | p;
+      chained->insert(files[f], p, frame);
+      parts[BufHashTbl::hash(key) % BUFPARTITIONS].table->insert(key, frame);
+    }
+
+  const char* names[3] = { "chained", "latched", "peek" };
+  cout << "# entries=" << entries << " millis=" << millis << endl;
+  cout << "threads\timpl\tlookups_per_s" << endl;
+  for (int threads = 1; threads <= maxThreads; threads *= 2) {
+    for (int impl = 0; impl < 3; impl++) {
+      vector<long> done(threads);
+      vector<thread> workers;
+      stop = false;
+      for (int t = 0; t < threads; t++)
+	workers.push_back(thread(lookups, impl, t + 1, &done[t]));
+      this_thread::sleep_for(chrono::milliseconds(millis));
+      stop = true;
+      long total = 0;
+      for (int t = 0; t < threads; t++) {
+	workers[t].join();
+	total += done[t];
+      }
+      cout << threads << "\t" << names[impl] << "\t"
+	   << (long) (total * 1000.0 / millis) << endl;
+    }
+  }
+
+  for (int i = 0; i < BUFPARTITIONS; i++)
+    delete parts[i].table;
+  delete [] parts;
+  delete chained;
+  return 0;
+}
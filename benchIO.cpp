@@ -0,0 +1,129 @@
+// Buffered versus direct file I/O under the buffer pool.
+//
+// Reads random pages of a file through a BufMgr, once with the file
+// opened normally and once opened for direct I/O, and prints for each the
+// page reads per second, the pool's hit ratio and the memory holding the
+// file's pages: the pool, and what the kernel keeps of the file in its
+// page cache.  With buffered I/O most pages end up cached twice.
+//
+// usage: benchIO [filePages [frames [millisPerRun]]]
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include "page.h"
+#include "buf.h"
+
+BufMgr*     bufMgr;
+
+static const char* NAME = "benchio.db";
+
+// kilobytes of the file in the kernel's page cache
+static long cachedKB(const long bytes)
+{
+  int fd = open(NAME, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  void* map = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return -1;
+  long pageSize = sysconf(_SC_PAGESIZE);
+  vector<unsigned char> resident((bytes + pageSize - 1) / pageSize);
+  long kb = 0;
+  if (mincore(map, bytes, &resident[0]) == 0)
+    for (size_t i = 0; i < resident.size(); i++)
+      if (resident[i] & 1)
+	kb += pageSize / 1024;
+  munmap(map, bytes);
+  return kb;
+}
+
+// empty the kernel's cache of the file
+static void dropCache()
+{
+  int fd = open(NAME, O_RDONLY);
+  if (fd < 0)
+    return;
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+int main(int argc, char** argv)
+{
+  int filePages = argc > 1 ? atoi(argv[1]) : 65536;
+  int frames = argc > 2 ? atoi(argv[2]) : 16384;
+  int millis = argc > 3 ? atoi(argv[3]) : 2000;
+  if (filePages < 1 || frames < 1 || millis < 1) {
+    cerr << "usage: benchIO [filePages [frames [millisPerRun]]]" << endl;
+    return 1;
+  }
+
+  DB db;
+  File* file;
+  Status status;
+  if (access(NAME, F_OK) == 0)
+    (void)db.destroyFile(NAME);
+  if ((status = db.createFile(NAME)) != OK ||
+      (status = db.openFile(NAME, file)) != OK) {
+    Error().print(status);
+    return 1;
+  }
+  for (int p = 0; p < filePages; p++) {
+    int pageNo;
+    if ((status = file->allocatePage(pageNo)) != OK) {
+      Error().print(status);
+      return 1;
+    }
+  }
+  db.closeFile(file);
+  long fileBytes = (long) (filePages + 1) * sizeof(Page);
+
+  cout << "# filePages=" << filePages << " frames=" << frames
+       << " millis=" << millis << endl;
+  cout << "mode\treads_per_s\thit_ratio\tpool_kb\tpagecache_kb" << endl;
+  for (int direct = 0; direct < 2; direct++) {
+    dropCache();
+    bufMgr = new BufMgr(frames);
+    if ((status = db.openFile(NAME, file, direct)) != OK) {
+      Error().print(status);
+      return 1;
+    }
+    unsigned int state = 1;
+    long reads = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    chrono::steady_clock::time_point end = start + chrono::milliseconds(millis);
+    while (chrono::steady_clock::now() < end) {
+      for (int k = 0; k < 256; k++) {
+	state = state * 1103515245 + 12345;
+	int pageNo = 1 + (state >> 4) % filePages;
+	Page* page;
+	if (bufMgr->readPage(file, pageNo, page) != OK ||
+	    bufMgr->unPinPage(file, pageNo, false) != OK) {
+	  cerr << "reading page " << pageNo << " failed" << endl;
+	  return 1;
+	}
+      }
+      reads += 256;
+    }
+    double secs = chrono::duration<double>(chrono::steady_clock::now()
+					   - start).count();
+    const BufStats& stats = bufMgr->getBufStats();
+    printf("%s\t%.0f\t%.4f\t%ld\t%ld\n",
+	   file->isDirect() ? "direct" : (direct ? "direct(unsupported)" : "buffered"),
+	   reads / secs, 1.0 - (double) stats.diskreads / stats.accesses,
+	   (long) frames * sizeof(Page) / 1024, cachedKB(fileBytes));
+    db.closeFile(file);
+    delete bufMgr;
+  }
+  bufMgr = NULL;
+  db.destroyFile(NAME);
+  return 0;
+}
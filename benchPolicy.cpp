@@ -0,0 +1,137 @@
+// Hit ratio and cost per page access of the replacement policies.
+//
+// Replays a page reference trace through a BufMgr with each policy and
+// prints, per policy, the fraction of readPage() calls that found the
+// page in the pool and the average time of a readPage()/unPinPage() pair.
+//
+// A trace is a text file with one reference per line, "file page": file
+// numbers start at 0, page numbers at 1.  Without a trace file a mixed
+// load is generated: point lookups that mostly hit a hot set of pages of
+// file 0, with a sequential scan of the larger file 1 now and then.
+//
+// usage: benchPolicy [frames [traceFile]]
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include "page.h"
+#include "buf.h"
+#include "bufPolicy.h"
+
+BufMgr*     bufMgr;
+
+typedef pair<int, int> Ref;  // (file, page)
+
+// the generated load: frames sized hot set, scans twice the pool size
+static void generate(const int frames, vector<Ref>& trace)
+{
+  const int lookupPages = 4 * frames;
+  const int scanPages = 2 * frames;
+  unsigned int state = 1;
+  for (int n = 0; n < 400 * frames; n++) {
+    state = state * 1103515245 + 12345;
+    unsigned int r = state >> 8;
+    //80% of the lookups go to a fifth of the pages
+    int page = r % 10 < 8 ? r / 10 % (lookupPages / 5) : r / 10 % lookupPages;
+    trace.push_back(Ref(0, 1 + page));
+    if (n % (20 * frames) == 20 * frames - 1)
+      for (int p = 1; p <= scanPages; p++)
+	trace.push_back(Ref(1, p));
+  }
+}
+
+static bool load(const char* name, vector<Ref>& trace)
+{
+  ifstream in(name);
+  if (!in)
+    return false;
+  string line;
+  while (getline(in, line)) {
+    istringstream fields(line);
+    Ref ref;
+    if (fields >> ref.first >> ref.second && ref.first >= 0 && ref.second > 0)
+      trace.push_back(ref);
+  }
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 256;
+  vector<Ref> trace;
+  if (frames < 1 || (argc > 2 && !load(argv[2], trace))) {
+    cerr << "usage: benchPolicy [frames [traceFile]]" << endl;
+    return 1;
+  }
+  if (argc <= 2)
+    generate(frames, trace);
+
+  //files with as many pages as the trace uses
+  vector<int> size;
+  for (size_t n = 0; n < trace.size(); n++) {
+    if (trace[n].first >= (int) size.size())
+      size.resize(trace[n].first + 1, 0);
+    size[trace[n].first] = max(size[trace[n].first], trace[n].second);
+  }
+  DB db;
+  vector<File*> files(size.size());
+  for (size_t f = 0; f < size.size(); f++) {
+    char name[32];
+    sprintf(name, "policy.%d", (int) f);
+    if (access(name, F_OK) == 0)
+      (void)db.destroyFile(name);
+    Status status;
+    if ((status = db.createFile(name)) != OK ||
+	(status = db.openFile(name, files[f])) != OK) {
+      Error().print(status);
+      return 1;
+    }
+    for (int p = 0; p < size[f]; p++) {
+      int pageNo;
+      if ((status = files[f]->allocatePage(pageNo)) != OK) {
+	Error().print(status);
+	return 1;
+      }
+    }
+  }
+
+  cout << "# frames=" << frames << " refs=" << trace.size() << endl;
+  cout << "policy\thit_ratio\tns_per_op" << endl;
+  ReplPolicy policies[] = { CLOCK, LRUK, TWOQ, ARC, CLOCKPRO };
+  for (int i = 0; i < 5; i++) {
+    bufMgr = new BufMgr(frames, BUFPARTITIONS, policies[i]);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t n = 0; n < trace.size(); n++) {
+      Page* page;
+      File* file = files[trace[n].first];
+      if (bufMgr->readPage(file, trace[n].second, page) != OK ||
+	  bufMgr->unPinPage(file, trace[n].second, false) != OK) {
+	cerr << "reading page " << trace[n].second << " failed" << endl;
+	return 1;
+      }
+    }
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now()
+					       - start).count();
+    const BufStats& stats = bufMgr->getBufStats();
+    printf("%s\t%.4f\t%.0f\n", BufPolicy::name(policies[i]),
+	   1.0 - (double) stats.diskreads / stats.accesses, ns / trace.size());
+    for (size_t f = 0; f < files.size(); f++)
+      bufMgr->flushFile(files[f]);
+    delete bufMgr;
+  }
+
+  bufMgr = NULL;
+  for (size_t f = 0; f < files.size(); f++) {
+    char name[32];
+    sprintf(name, "policy.%d", (int) f);
+    db.closeFile(files[f]);
+    db.destroyFile(name);
+  }
+  return 0;
+}
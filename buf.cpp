@@ -27,10 +27,17 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <new>
 #include <iostream>
 #include <stdio.h>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 #include "page.h"
 #include "buf.h"
+#include "bufPolicy.h"
+#include "ioEngine.h"
 
 #define ASSERT(c)  { if (!(c)) {				\
       cerr << "At line " << __LINE__ << ":" << endl << "  ";	\
@@ -39,37 +46,143 @@
     }								\
   }
 
+BufRing::BufRing(const int size)
+{
+  this->size = size < 1 ? 1 : size;
+  frames = new int[this->size];
+  pages = new PageId[this->size];
+  for (int i = 0; i < this->size; i++) {
+    frames[i] = -1;
+    pages[i] = 0;
+  }
+  next = 0;
+}
+
+BufRing::~BufRing()
+{
+  delete [] frames;
+  delete [] pages;
+}
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(const int bufs)
+BufMgr::BufMgr(const int bufs, const int partitions,
+	       const ReplPolicy replacement, const int poolFlags,
+	       const int maxBufs)
 {
   numBufs = bufs;
+  //resize() can grow the pool up to maxBufs frames
+  this->maxBufs = max(bufs, maxBufs > 0 ? maxBufs : POOLRESERVE * bufs);
   //array of buffer description table; only contains description of a table
-  bufTable = new BufDesc[bufs];
-  //allocate memory for the bufTable
-  memset(bufTable, 0, bufs * sizeof(BufDesc));
+  bufTable = new BufDesc[this->maxBufs];
   //buf descritption table; set the frame number;
-  for (int i = 0; i < bufs; i++) 
+  for (int i = 0; i < this->maxBufs; i++) 
     {
       bufTable[i].frameNo = i;
       //initially there is nothing in the buffer pool;
       //so valid bits are all false for all frames
       bufTable[i].valid = false;
+      //frames beyond the pool stay claimed until resize() adds them
+      if (i >= bufs)
+	bufTable[i].claim();
     }
   //actual buffer pool; buffer pool is an array of PAGE pointers
-  bufPool = new Page[bufs];
-  memset(bufPool, 0, bufs * sizeof(Page));
-  int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
-  //initalize clockhand as num of pages in the buffer pool-1;
-  //so that the first time we call the advance clockhand, it points to
-  //the 0th page in the buffer pool
-  clockHand = bufs - 1;
-  /*code for advance clockhand
-    clockhand = (clockhand + 1) %numBufs
-  */
+  allocPool(bufs, this->maxBufs, poolFlags);
+  //the page table is split into partitions with a latch each, so that
+  //threads working on different pages do not serialize on one latch
+  numParts = partitions < 1 ? 1 : partitions;
+  parts = new BufPartition[numParts];
+  //each partition gets its share of the pages plus some slack, so that
+  //its table does not have to grow when the pages are spread unevenly
+  int htsize = ((int) (bufs * 1.2)) / numParts + 1;
+  for (int i = 0; i < numParts; i++)
+    parts[i].table = new BufHashTbl (htsize);  // allocate the buffer hash table
+  //the replacement policy decides which frames allocBuf() reuses
+  policy = BufPolicy::create(replacement, bufTable, bufs, &metrics,
+			     this->maxBufs);
+  //no background writer until startWriter()
+  writerOn = false;
+  writerStop = false;
+  writerTarget = 0;
+  //prefetch() and writeBack() keep many requests in flight through
+  //io_uring where the kernel allows it
+  io = IOEngine::create();
+}
+
+/*
+ * Map the memory of the buffer pool.  Anonymous memory is zeroed by the
+ * kernel, so frames need no initialization; unless POOLLAZY is given the
+ * frames in use are faulted in here rather than on the first access of
+ * each frame.  The frames resize() may add later only take address space,
+ * except with POOLHUGETLB, which reserves huge pages for all of them.
+ * @param bufs, the number of frames in use
+ *        capacity, the number of frames mapped
+ *        flags, POOLHUGE, POOLHUGETLB and POOLLAZY or'ed together
+ */
+void BufMgr::allocPool(const int bufs, const int capacity, const int flags) {
+  bool huge = flags & (POOLHUGE | POOLHUGETLB);
+  poolLazy = flags & POOLLAZY;
+  poolPage = sysconf(_SC_PAGESIZE);
+  poolBytes = (size_t) capacity * sizeof(Page);
+  if(huge){
+    poolBytes = (poolBytes + HUGEPAGESIZE - 1) & ~(HUGEPAGESIZE - 1);
+  }
+  void* mem = MAP_FAILED;
+  if(flags & POOLHUGETLB){
+    //the huge pages are reserved by mmap(), so touching them cannot fail
+    mem = mmap(NULL, poolBytes, PROT_READ | PROT_WRITE,
+	       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(mem != MAP_FAILED){
+      poolPage = HUGEPAGESIZE;
+    }
+  }
+  if(mem == MAP_FAILED && huge){
+    //map a huge page more than needed and cut the pool out of it at a
+    //huge page boundary, so that all of it can be backed by huge pages
+    char* raw = (char*) mmap(NULL, poolBytes + HUGEPAGESIZE,
+			     PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(raw != MAP_FAILED){
+      char* start = (char*) (((uintptr_t) raw + HUGEPAGESIZE - 1)
+			     & ~(uintptr_t) (HUGEPAGESIZE - 1));
+      if(start > raw){
+	munmap(raw, start - raw);
+      }
+      munmap(start + poolBytes, raw + HUGEPAGESIZE - start);
+      //after the madvise() touching the pool faults in huge pages
+      madvise(start, poolBytes, MADV_HUGEPAGE);
+      mem = start;
+    }
+  }
+  if(mem == MAP_FAILED && !huge){
+    mem = mmap(NULL, poolBytes, PROT_READ | PROT_WRITE,
+	       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+  if(mem == MAP_FAILED){
+    //as new Page[bufs] would
+    throw bad_alloc();
+  }
+  bufPool = (Page*) mem;
+  if(!poolLazy){
+    touchPool(0, bufs);
+  }
+}
+
+/*
+ * Fault in the memory of some frames nobody uses yet, by writing to each
+ * page of it.  A page shared with frames in use is left alone: it is
+ * backed already, and writing to it could clobber their contents.
+ * @param from, to, the frames from..to-1
+ */
+void BufMgr::touchPool(const int from, const int to) {
+  size_t step = sysconf(_SC_PAGESIZE);
+  size_t off = ((size_t) from * sizeof(Page) + step - 1) & ~(step - 1);
+  size_t end = (size_t) to * sizeof(Page);
+  for(; off < end; off += step){
+    ((volatile char*) bufPool)[off] = 0;
+  }
 }
 
 /*
@@ -77,99 +190,415 @@ BufMgr::BufMgr(const int bufs)
  * memory that buffer pool used
  */
 BufMgr::~BufMgr() {
-  // TODO: Implement this method by looking at the description in the writeup.
+  stopWriter();
+  //let the prefetch reads in flight finish
+  io->drain();
+  //write the dirty pages back to the disk, in file and page order
+  vector<int> dirty;
   for(int i = 0; i < numBufs; i++){
-    //if the frame is valid
-    if(bufTable[i].valid){
-      //if this page is dirty
-      if(bufTable[i].dirty){
-	//write back to the disk
-	bufTable[i].file->writePage(bufTable[i].pageNo, &bufPool[i]);
-      }
+    if(bufTable[i].valid && bufTable[i].dirty){
+      dirty.push_back(i);
     }
   }
+  writeBack(dirty);
+  delete io;
+  delete policy;
   //free buffer description table
   delete [] bufTable;
   //free actually buffer pool
-  delete [] bufPool;
+  munmap(bufPool, poolBytes);
   //free hashtable
-  // delete hashTable;
+  for(int i = 0; i < numParts; i++){
+    delete parts[i].table;
+  }
+  delete [] parts;
 }
 
 
 
 /*
- * Allocates a free frame usign the clock algorithm; if necessary writing a dirty page
+ * Allocates a free frame using the replacement policy; if necessary writing a dirty page
  * back to disk
- * @param int &frame the allocated frameNo
+ * @param int &frame the allocated frameNo; the frame is returned claimed
+ *        (see BufDesc), the caller fills it and calls installPage() or
+ *        releaseBuf()
+ *        incoming, the page the frame is for
  * @return OK on success
  * BUFFEREXCEEDED if all buffer frames are pinned
  * UNIXERR if the call to the I/O returned an error when a dirty page to disk
 */
-const Status BufMgr::allocBuf(int & frame) {
-  // TODO: Implement this method by looking at the description in the writeup.
-  // we only advance numBufs times clockhand; if we dont find anything, then return 
-  // BUFFEREXCEEDED
-  int numPin = 0;
-  int count = 0;
+const Status BufMgr::allocBuf(int & frame, const PageId incoming) {
+  uint64_t start = latency.start();
   while(1){
-    //clock algo
-    advanceClock();
-    count++;
-    if(count % numBufs == 0){
-      numPin = 0;
+    //ask the policy for a frame to replace
+    int victim = policy->victim(incoming);
+    if(victim < 0){
+      //all frames in the buffer pool are pinned
+      latency.record(VICTIM, start);
+      return BUFFEREXCEEDED;
+    }
+    BufDesc* desc = &bufTable[victim];
+    //take the frame unless somebody pinned it since; then ask again
+    if(!desc->claim()){
+      continue;
     }
+    latency.record(VICTIM, start);
     //if current frame is not valid
-    if(!bufTable[clockHand].valid){
-      //mark this frame valid
-      bufTable[clockHand].valid = true;
+    if(!desc->valid){
       //give the frameNo out to the caller for further use
-      frame = clockHand;
+      frame = victim;
       return OK;
     }
-    //the frame is valid
-    else{
-      //check if the frame is recently referenced
-      if(bufTable[clockHand].refbit){
-	//recently referenced, clear the ref bit and advance the clock
-	bufTable[clockHand].refbit = false;
+    //not pinned; check if its dirty.  Hits on this page wait while
+    //we hold the claim, so nobody changes it during the write
+    if(desc->dirty){
+      //the background writer has fallen behind; wake it up
+      if(writerOn){
+	writerWake.notify_one();
+      }
+      desc->dirty = false;
+      if(desc->file.load()->writePage(pageNoOf(desc->pageId), &bufPool[victim],
+				      &latency) != OK){
+	desc->dirty = true;
+	desc->unclaim(0);
+	return UNIXERR;
       }
-      //if not recently referenced
-      else{
-	//not pinned
-	if(bufTable[clockHand].pinCnt == 0){
-	  //check if its dirty
-	  //is dirty
-	  if(bufTable[clockHand].dirty){	    
-	    if(bufTable[clockHand].file->writePage(bufTable[clockHand].pageNo, &bufPool[clockHand]) != OK){
-	      return UNIXERR;
-	    }
-	  }
-	  //not dirty or successfully write back the dirty frame to disk
-	  //clear the chosen frame
-	  Status temp =  hashTable->remove(bufTable[clockHand].file, bufTable[clockHand].pageNo); 
-	  if (temp != OK)
-	  return temp;
-	  bufTable[clockHand].Clear();
-	  //give the frameNo out to the caller for further use
-	  frame = clockHand;
-	  return OK;
-	} //end of not pinned -> true
-	//this frame is pinned
-	else{
-	  //increment the number of pinned frame
-	  if(++numPin == numBufs){
-	    //all frames in the buffer pool is pinned
-	    //break out the endless loop
-	    break;
-	  }
+      bufStats.diskwrites++;
+      metrics.count(desc->file, WRITES);
+      metrics.count(desc->file, EVICTDIRTY);
+    } else {
+      metrics.count(desc->file, EVICTCLEAN);
+    }
+    //not dirty or successfully write back the dirty frame to disk
+    //clear the chosen frame
+    BufPartition& part = partition(desc->pageId);
+    part.latch.lock();
+    Status temp = part.table->remove(desc->pageId);
+    desc->Clear();
+    part.latch.unlock();
+    if(temp != OK){
+      desc->unclaim(0);
+      return temp;
+    }
+    policy->evicted(victim);
+    //give the frameNo out to the caller for further use
+    frame = victim;
+    return OK;
+  }
+}
+
+/*
+ * allocBuf() for several pages at once: a victim is claimed for every page
+ * before any is evicted, so that the dirty ones among them are written
+ * back together by writeBack()
+ * @param &frames returns the frames, claimed as from allocBuf(); one per
+ *        page, in the order of incoming
+ *        incoming, the pages the frames are for
+ * @return OK on success
+ *         BUFFEREXCEEDED if there are not that many unpinned frames
+ *         UNIXERR if a dirty page could not be written back
+ *         on an error no frame is claimed or evicted
+ */
+const Status BufMgr::allocBufs(vector<int>& frames, const vector<PageId>& incoming) {
+  frames.clear();
+  Status status = OK;
+  //frames we claim look pinned to the policy, so it proposes new ones
+  for(size_t i = 0; i < incoming.size(); ){
+    int victim = policy->victim(incoming[i]);
+    if(victim < 0){
+      status = BUFFEREXCEEDED;
+      break;
+    }
+    if(bufTable[victim].claim()){
+      frames.push_back(victim);
+      i++;
+    }
+  }
+  vector<int> dirty;
+  if(status == OK){
+    for(size_t i = 0; i < frames.size(); i++){
+      if(bufTable[frames[i]].valid && bufTable[frames[i]].dirty){
+	dirty.push_back(frames[i]);
+      }
+    }
+    if(!dirty.empty()){
+      //the background writer has fallen behind; wake it up
+      if(writerOn){
+	writerWake.notify_one();
+      }
+      status = writeBack(dirty);
+    }
+  }
+  if(status != OK){
+    for(size_t i = 0; i < frames.size(); i++){
+      bufTable[frames[i]].unclaim(0);
+    }
+    frames.clear();
+    return status;
+  }
+  for(size_t i = 0; i < frames.size(); i++){
+    BufDesc* desc = &bufTable[frames[i]];
+    if(desc->valid){
+      bool written = find(dirty.begin(), dirty.end(), frames[i]) != dirty.end();
+      metrics.count(desc->file, written ? EVICTDIRTY : EVICTCLEAN);
+      BufPartition& part = partition(desc->pageId);
+      part.latch.lock();
+      part.table->remove(desc->pageId);
+      desc->Clear();
+      part.latch.unlock();
+      policy->evicted(frames[i]);
+    }
+  }
+  return OK;
+}
+
+/*
+ * Allocates a frame for a page read through a ring: the ring's next frame,
+ * if it still holds the page the ring read into it and can be had without
+ * waiting or writing, else a frame from allocBuf() that then takes its
+ * place in the ring
+ * @param *ring, the scan's ring
+ *        &frame, incoming as for allocBuf()
+ * @return as allocBuf()
+ */
+const Status BufMgr::ringBuf(BufRing* ring, int & frame, const PageId incoming) {
+  //a ring never takes more than an eighth of the pool
+  int size = min(ring->size, max(1, numBufs / 8));
+  int slot = ring->next % size;
+  ring->next = (slot + 1) % size;
+  int old = ring->frames[slot];
+  if(old >= 0){
+    BufDesc* desc = &bufTable[old];
+    if(desc->claim()){
+      //the policy may have replaced the page; then the frame is no
+      //longer the scan's to recycle
+      if(desc->valid && desc->pageId == ring->pages[slot] && !desc->dirty){
+	//the scan is done with this page; it does not go to the ghost
+	//lists of the policy, hence dropped() rather than evicted()
+	metrics.count(desc->file, EVICTCLEAN);
+	BufPartition& part = partition(desc->pageId);
+	part.latch.lock();
+	part.table->remove(desc->pageId);
+	desc->Clear();
+	part.latch.unlock();
+	policy->dropped(old);
+	frame = old;
+	ring->pages[slot] = incoming;
+	return OK;
+      }
+      desc->unclaim(0);
+    }
+  }
+  //an empty slot, or its frame is pinned, dirty or another page's:
+  //replace it
+  Status status = allocBuf(frame, incoming);
+  if(status == OK){
+    ring->frames[slot] = frame;
+    ring->pages[slot] = incoming;
+  }
+  return status;
+}
+
+/*
+ * Write the dirty pages in some frames back to disk.  The frames are
+ * sorted by page, and each run of consecutive pages of a file is written
+ * with one request from its first dirty page to its last; clean pages in
+ * between are written again rather than splitting the run.  The requests
+ * of all runs are in flight at the same time.  Nobody may change the
+ * frames meanwhile: the caller has claimed them, or is the destructor.
+ * @param frames, valid frames; sorted on return
+ * @return OK on success; only the pages that were dirty count as written
+ *         UNIXERR if a write failed; the pages of the runs that failed
+ *         that were dirty are dirty again
+ */
+const Status BufMgr::writeBack(vector<int>& frames) {
+  sort(frames.begin(), frames.end(), [this](int a, int b) {
+      return bufTable[a].pageId < bufTable[b].pageId;
+    });
+  //the dirty part of each run, split into requests of IOMAXPAGES pages
+  vector<pair<size_t, size_t> > runs;
+  size_t n = frames.size();
+  for(size_t i = 0; i < n; ){
+    //the run of consecutive pages starting at i
+    size_t j = i + 1;
+    while(j < n && bufTable[frames[j]].pageId == bufTable[frames[j - 1]].pageId + 1){
+      j++;
+    }
+    //without its clean pages at either end
+    size_t first = i, last = j;
+    while(first < last && !bufTable[frames[first]].dirty){
+      first++;
+    }
+    while(last > first && !bufTable[frames[last - 1]].dirty){
+      last--;
+    }
+    for(size_t k = first; k < last; k += IOMAXPAGES){
+      runs.push_back(make_pair(k, min(last, k + IOMAXPAGES)));
+    }
+    i = j;
+  }
+  if(runs.empty()){
+    return OK;
+  }
+  vector<IORequest> reqs(runs.size());
+  vector<IORequest*> submit;
+  vector<struct iovec> iov(n);
+  vector<bool> wasDirty(n);
+  IOBatch batch;
+  for(size_t r = 0; r < runs.size(); r++){
+    size_t first = runs[r].first, last = runs[r].second;
+    for(size_t k = first; k < last; k++){
+      iov[k].iov_base = &bufPool[frames[k]];
+      iov[k].iov_len = sizeof(Page);
+      wasDirty[k] = bufTable[frames[k]].dirty;
+      bufTable[frames[k]].dirty = false;
+    }
+    BufDesc* desc = &bufTable[frames[first]];
+    if(desc->file.load()->ioRequest(reqs[r], true, pageNoOf(desc->pageId),
+				    &iov[first], last - first, &latency) == OK){
+      batch.add(reqs[r]);
+      submit.push_back(&reqs[r]);
+    }
+  }
+  if(!submit.empty()){
+    io->submit(&submit[0], submit.size());
+  }
+  batch.wait();
+  Status status = OK;
+  for(size_t r = 0; r < runs.size(); r++){
+    size_t first = runs[r].first, last = runs[r].second;
+    //the clean pages filling gaps in the run do not count
+    int dirty = 0;
+    for(size_t k = first; k < last; k++){
+      dirty += wasDirty[k];
+    }
+    if(reqs[r].result != (ssize_t) ((last - first) * sizeof(Page))){
+      for(size_t k = first; k < last; k++){
+	if(wasDirty[k]){
+	  bufTable[frames[k]].dirty = true;
 	}
-      }// end of rencenty referenced checking
-    } // end of valid checking
-  } // endless loop
-  //fall off the for loop, meaning every frame in the buffer pool is pinned
-  return BUFFEREXCEEDED;
+      }
+      status = UNIXERR;
+    } else {
+      bufStats.diskwrites += dirty;
+      metrics.count(bufTable[frames[first]].file, WRITES, dirty);
+    }
+  }
+  return status;
 }
+
+/*
+ * Return a frame obtained from allocBuf() unused; if installPage() has
+ * already entered it in the page table it is removed again
+ * @param frame, the frame to give back
+ */
+const void BufMgr::releaseBuf(int frame) {
+  BufDesc* desc = &bufTable[frame];
+  if(desc->valid){
+    BufPartition& part = partition(desc->pageId);
+    part.latch.lock();
+    part.table->remove(desc->pageId);
+    desc->Clear();
+    part.latch.unlock();
+    policy->dropped(frame);
+  }
+  desc->Clear();
+  desc->unclaim(0);
+}
+
+/*
+ * Enter a page into the page table before it is read into a frame from
+ * allocBuf().  The frame stays claimed, so threads looking for the page
+ * wait until the caller has read it and called unclaim(1).  If the page
+ * is in the buffer pool already, the frame is released and the page's
+ * frame is pinned instead.
+ * @param *file, id the page that is going to be read
+ *        &frame in: the frame from allocBuf, out: the frame to use
+ *        &found returns true if the page was in the pool already
+ *        wait, false to return at once if the page is in the pool
+ *        already, with frame -1 and without pinning it
+ * @return OK on success
+ *         HASHTBLERROR if the page could not be entered in the page table
+ */
+const Status BufMgr::installPage(File* file, const PageId id, int& frame,
+				 bool& found, const bool wait) {
+  BufPartition& part = partition(id);
+  int existing = -1;
+  while(1){
+    part.latch.lock();
+    if(part.table->lookup(id, existing) != OK){
+      break;
+    }
+    if(!wait){
+      part.latch.unlock();
+      releaseBuf(frame);
+      frame = -1;
+      found = true;
+      return OK;
+    }
+    if(bufTable[existing].tryPin()){
+      part.latch.unlock();
+      policy->accessed(existing);
+      releaseBuf(frame);
+      frame = existing;
+      found = true;
+      return OK;
+    }
+    //that frame is being read, evicted or written back; wait for it
+    part.latch.unlock();
+    metrics.countId(fileIdOf(id), PINWAITS);
+    this_thread::yield();
+  }
+  if(part.table->insert(id, frame) != OK){
+    part.latch.unlock();
+    releaseBuf(frame);
+    return HASHTBLERROR;
+  }
+  //invoke set()
+  bufTable[frame].Set(file, id);
+  part.latch.unlock();
+  policy->loaded(frame, id);
+  found = false;
+  return OK;
+}
+
+/*
+ * Pin the frame holding a page, if the page is in the buffer pool.  The
+ * page table is read without latching; the frame found that way is
+ * pinned and then checked to still hold the page.
+ * @param id the page
+ *        &frame returns the frame holding the page
+ * @return true if the page was found and pinned
+ */
+bool BufMgr::pinPage(const PageId id, int& frame) {
+  BufPartition& part = partition(id);
+  while(1){
+    if(part.table->peek(id, frame) != OK){
+      //a writer moving entries can hide the page from peek()
+      part.latch.lock_shared();
+      Status lk = part.table->lookup(id, frame);
+      part.latch.unlock_shared();
+      if(lk != OK){
+	return false;
+      }
+    }
+    BufDesc* desc = &bufTable[frame];
+    if(!desc->tryPin()){
+      //claimed for eviction or write back; wait for that to finish
+      metrics.countId(fileIdOf(id), PINWAITS);
+      this_thread::yield();
+      continue;
+    }
+    //while we hold a pin the frame cannot change its page
+    if(desc->valid && desc->pageId == id){
+      //tell the replacement policy
+      policy->accessed(frame);
+      return true;
+    }
+    desc->pinCnt--;
+  }
+}
+
 /*
  * Read a page in a file; Handling two cases: 1. the page is in the buffer pool
  * 2. the page is not in the buffer pool -> bring it in
@@ -177,6 +606,8 @@ const Status BufMgr::allocBuf(int & frame) {
  * @param *file the file pointer pointing to from which file we read
  * PageNo the page number in the file that we want to read
  * *&page return a pointer to the frame containing the page via this pointer
+ * *ring if not NULL, the page is read into one of the ring's frames if it
+ * is not in the pool (see BufRing)
 
  * @return OK if no error
  * UNIXERR if unix error occured
@@ -184,47 +615,258 @@ const Status BufMgr::allocBuf(int & frame) {
  * HASHTBLERROR -> dont think lookup() will generate any hashtable error
  * -> insert may generate this error
 */
-const Status BufMgr::readPage(File* file, const int PageNo, Page*& page) {
-  // TODO: Implement this method by looking at the description in the writeup.
+const Status BufMgr::readPage(File* file, const int PageNo, Page*& page,
+			      BufRing* ring) {
   int frame = -1;
-  //if we found the page in the buffer pool
-  if(hashTable->lookup(file, PageNo, frame) == OK){
-    //now we found the frame number in the buffer pool containing the page
-    //set ref bit
-    bufTable[frame].refbit = true;
-    //pin count incremented
-    bufTable[frame].pinCnt++;
+  bufStats.accesses++;
+  curve.record(pageIdOf(file, PageNo));
+  Status status = fetchPage(file, PageNo, frame, ring);
+  if(status == OK){
+    //only calls that pin are traced: replaying a failed one would pin
+    trace.record(TRACEREAD, file, PageNo);
+    //return the page pointer
     page = &bufPool[frame];
+  }
+  return status;
+}
+
+/*
+ * The work of readPage(): pin a page, reading it into the pool if it is
+ * not there.  The caller records the access in the curve.
+ * @param *file, PageNo, *ring as for readPage()
+ *        &frame returns the frame holding the page
+ * @return as readPage()
+ */
+const Status BufMgr::fetchPage(File* file, const int PageNo, int& frame,
+			       BufRing* ring) {
+  uint64_t start = latency.start();
+  PageId id = pageIdOf(file, PageNo);
+  //if we found the page in the buffer pool
+  if(pinPage(id, frame)){
+    metrics.count(file, HITS);
+    latency.record(READHIT, start);
     return OK;
   }
   //if we have not found the page in the buffer pool
-  else{
-    Status abstatus = allocBuf(frame);
-    if(abstatus == OK){
-      //read the pageNo in file from disk to memory address specified
-      //by page pointer in the buffer pool frame allocated by allocBuf
-      if((file->readPage(PageNo, &bufPool[frame])) == OK){
-	//now we successfully read the page from disk to the buffer pool
-	//insert entry into the hashtable
-	if((hashTable->insert(file, PageNo, frame)) != OK){
-	  return HASHTBLERROR;
-	}//end of unable to insert the page table entry
-	//invoke set()
-	bufTable[frame].Set(file, PageNo);
-	//return the page pointer
-	page = &bufPool[frame];
- 	//then it would return OK in the end of the function
-      }else{
-	return UNIXERR;
-      }// end of unable to read the page from the disk     
-    } // end of did successfully allocate a buffer in the buffer pool for this page
-    else{
-      return abstatus;
-    }//end of not found the page in the buffer pool
+  metrics.count(file, MISSES);
+  Status abstatus = ring ? ringBuf(ring, frame, id) : allocBuf(frame, id);
+  if(abstatus != OK){
+    return abstatus;
+  }
+  //insert entry into the hashtable first, so that nobody else reads
+  //the page while we do
+  bool found;
+  if(installPage(file, id, frame, found) != OK){
+    return HASHTBLERROR;
+  }
+  if(!found){
+    //read the pageNo in file from disk to memory address specified
+    //by page pointer in the buffer pool frame allocated by allocBuf
+    if((file->readPage(PageNo, &bufPool[frame], &latency)) != OK){
+      releaseBuf(frame);
+      return UNIXERR;
+    }
+    bufStats.diskreads++;
+    metrics.count(file, READS);
+    //now we successfully read the page from disk to the buffer pool
+    bufTable[frame].unclaim(1);
+  }
+  latency.record(READMISS, start);
+  return OK;
+}
+
+/*
+ * Read several pages of a file, as if by readPage() for each of them but
+ * cheaper: the pages in the pool are pinned in one pass, victims for the
+ * others are picked and written back together (allocBufs()) and the
+ * missing pages are read with one request per run of consecutive pages,
+ * all runs at the same time.  A page listed more than once is pinned
+ * that many times.
+ * @param *file, the file to read from
+ *        pageNos, the pages to read
+ *        pages, returns a pointer to the frame of each page
+ *        n, the number of pages
+ * @return OK on success
+ *         UNIXERR if a page could not be read or a dirty page written
+ *         BUFFEREXCEEDED if there are not enough unpinned frames
+ *         HASHTBLERROR if a hash table error occurred
+ *         on an error none of the pages is pinned
+ */
+const Status BufMgr::readPages(File* file, const int pageNos[], Page* pages[],
+			       const int n) {
+  bufStats.accesses += n;
+  vector<int> frameOf(n, -1);
+  //pin the pages that are in the pool
+  vector<int> misses;
+  for(int i = 0; i < n; i++){
+    curve.record(pageIdOf(file, pageNos[i]));
+    if(pinPage(pageIdOf(file, pageNos[i]), frameOf[i])){
+      metrics.count(file, HITS);
+    } else {
+      frameOf[i] = -1;
+      misses.push_back(i);
+    }
+  }
+  Status status = OK;
+  if(!misses.empty()){
+    status = readMisses(file, pageNos, misses, frameOf);
+  }
+  if(status != OK){
+    for(int i = 0; i < n; i++){
+      if(frameOf[i] >= 0){
+	bufTable[frameOf[i]].pinCnt--;
+      }
+    }
+    return status;
+  }
+  for(int i = 0; i < n; i++){
+    pages[i] = &bufPool[frameOf[i]];
+    trace.record(TRACEREAD, file, pageNos[i]);
   }
   return OK;
 }
 
+/*
+ * The misses of readPages(): read and pin the pages pageNos[i] for i in
+ * misses
+ * @param *file, pageNos as for readPages()
+ *        misses, indexes into pageNos; sorted by page on return
+ *        frameOf, returns the frame of each page read, -1 for those that
+ *        could not be
+ * @return as readPages(); on an error some pages may be pinned, as
+ *         frameOf tells
+ */
+const Status BufMgr::readMisses(File* file, const int pageNos[],
+				vector<int>& misses, vector<int>& frameOf) {
+  sort(misses.begin(), misses.end(), [pageNos](int a, int b) {
+      return pageNos[a] < pageNos[b];
+    });
+  //the distinct pages; page d is listed at misses[start[d]] up to
+  //misses[start[d + 1]] - 1
+  vector<PageId> ids;
+  vector<size_t> start;
+  for(size_t m = 0; m < misses.size(); m++){
+    if(m == 0 || pageNos[misses[m]] != pageNos[misses[m - 1]]){
+      ids.push_back(pageIdOf(file, pageNos[misses[m]]));
+      start.push_back(m);
+    }
+  }
+  start.push_back(misses.size());
+  vector<int> frames;
+  Status status = allocBufs(frames, ids);
+  if(status != OK){
+    return status;
+  }
+  //enter the pages in the page table; like prefetch() we must not wait
+  //for other threads' claims while holding frames claimed and not read.
+  //Pages somebody else entered first get frame -1 and are pinned below
+  size_t d;
+  for(d = 0; d < ids.size(); d++){
+    bool found;
+    if(installPage(file, ids[d], frames[d], found, false) != OK){
+      //installPage() released that frame
+      frames[d] = -1;
+      status = HASHTBLERROR;
+      break;
+    }
+  }
+  for(d = d + 1; d < ids.size(); d++){
+    releaseBuf(frames[d]);
+    frames[d] = -1;
+  }
+  //one request per run of consecutive pages; ids are in page order
+  vector<pair<size_t, size_t> > runs;
+  for(d = 0; d < ids.size(); ){
+    if(frames[d] < 0){
+      d++;
+      continue;
+    }
+    size_t e = d + 1;
+    while(e < ids.size() && e - d < (size_t) IOMAXPAGES && frames[e] >= 0 &&
+	  ids[e] == ids[e - 1] + 1){
+      e++;
+    }
+    runs.push_back(make_pair(d, e));
+    d = e;
+  }
+  vector<IORequest> reqs(runs.size());
+  vector<IORequest*> submit;
+  vector<struct iovec> iov(ids.size());
+  IOBatch batch;
+  for(size_t r = 0; r < runs.size(); r++){
+    for(d = runs[r].first; d < runs[r].second; d++){
+      iov[d].iov_base = &bufPool[frames[d]];
+      iov[d].iov_len = sizeof(Page);
+    }
+    if(file->ioRequest(reqs[r], false, pageNoOf(ids[runs[r].first]),
+		       &iov[runs[r].first],
+		       runs[r].second - runs[r].first, &latency) == OK){
+      batch.add(reqs[r]);
+      submit.push_back(&reqs[r]);
+    }
+  }
+  if(!submit.empty()){
+    io->submit(&submit[0], submit.size());
+  }
+  batch.wait();
+  //pin what was read, a page as many times as it is listed
+  for(size_t r = 0; r < runs.size(); r++){
+    size_t read = reqs[r].result > 0 ? reqs[r].result / sizeof(Page) : 0;
+    for(d = runs[r].first; d < runs[r].second; d++){
+      if(d - runs[r].first >= read){
+	releaseBuf(frames[d]);
+	frames[d] = -1;
+	status = UNIXERR;
+	continue;
+      }
+      bufStats.diskreads++;
+      metrics.count(file, READS);
+      metrics.count(file, MISSES, start[d + 1] - start[d]);
+      for(size_t m = start[d]; m < start[d + 1]; m++){
+	frameOf[misses[m]] = frames[d];
+      }
+      bufTable[frames[d]].unclaim(start[d + 1] - start[d]);
+    }
+  }
+  //the pages other threads were reading; we hold no claims any more,
+  //so waiting for them is safe now
+  for(d = 0; d < ids.size() && status == OK; d++){
+    if(frames[d] >= 0){
+      continue;
+    }
+    for(size_t m = start[d]; m < start[d + 1] && status == OK; m++){
+      status = fetchPage(file, pageNos[misses[m]], frameOf[misses[m]], NULL);
+      if(status != OK){
+	frameOf[misses[m]] = -1;
+      }
+    }
+  }
+  return status;
+}
+
+/*
+ * Unpin several pages, as unPinPage() for each of them
+ * @param *file, the file of the pages
+ *        pageNos, the pages; a page listed more than once is unpinned
+ *        that many times
+ *        n, the number of pages
+ *        dirty, whether the caller changed the pages
+ * @return OK on success
+ *         HASHNOTFOUND or PAGENOTPINNED as unPinPage(), for the first
+ *         page it failed on; the others are unpinned nevertheless
+ */
+const Status BufMgr::unPinPages(File* file, const int pageNos[], const int n,
+				const bool dirty) {
+  Status status = OK;
+  for(int i = 0; i < n; i++){
+    Status s = unPinPage(file, pageNos[i], dirty);
+    if(status == OK){
+      status = s;
+    }
+  }
+  return status;
+}
+
 /*
  * Unpin a page in the buffer pool
  * @param *file, the file that contains the page needs to be unpinned
@@ -237,30 +879,76 @@ const Status BufMgr::readPage(File* file, const int PageNo, Page*& page) {
  */
 const Status BufMgr::unPinPage(File* file, const int PageNo, 
 			       const bool dirty) {
-  // TODO: Implement this method by looking at the description in the writeup.
   //used to store the frame no returned by hashtable lookup
   int frame = -1;
-  Status lk;
-  lk = hashTable->lookup(file, PageNo, frame);
+  Status lk = OK;
+  PageId id = pageIdOf(file, PageNo);
+  BufPartition& part = partition(id);
+  //the caller holds a pin, so the frame found by peek() is checked
+  //reliably; ask again under the latch if it is not the right one
+  if(part.table->peek(id, frame) != OK || bufTable[frame].pageId != id){
+    part.latch.lock_shared();
+    lk = part.table->lookup(id, frame);
+    part.latch.unlock_shared();
+  }
   if(lk == OK){
+    BufDesc* desc = &bufTable[frame];
     if(dirty){
       //set the dirty bit if dirty == true
-      bufTable[frame].dirty = true;
-    }
-    //decrement the pinCnt
-    if(bufTable[frame].pinCnt != 0){
-      bufTable[frame].pinCnt--;
-    }else{
-      return PAGENOTPINNED;
+      desc->dirty = true;
     }
-  }else{
-    return lk;
+    //decrement the pinCnt, unless it is already 0
+    int cnt = desc->pinCnt;
+    do {
+      if(cnt <= 0){
+	lk = PAGENOTPINNED;
+	break;
+      }
+    } while(!desc->pinCnt.compare_exchange_weak(cnt, cnt - 1));
   }
-  return OK;
+  if(lk == OK){
+    //a failed unpin is not traced, replaying it would unpin
+    trace.record(TRACEUNPIN, file, PageNo, dirty ? TRACEDIRTY : 0);
+  }
+  return lk;
 }
 
 
 
+/*
+ * readPage() pinning the page through a handle, which unpins it again
+ * @param *file, PageNo, *ring as for readPage()
+ *        &handle returns the pin; whatever it pinned before is released
+ * @return as readPage()
+ */
+const Status BufMgr::readPage(File* file, const int PageNo,
+			      PageHandle& handle, BufRing* ring) {
+  handle.release();
+  Page* page;
+  Status status = readPage(file, PageNo, page, ring);
+  if(status == OK){
+    handle.set(this, page - bufPool, PageNo);
+  }
+  return status;
+}
+
+/*
+ * Unpin a frame whose page the caller has pinned; no need to look the
+ * page up, the pin keeps it in the frame
+ * @param frame, the pinned frame
+ *        dirty, whether the caller changed the page
+ */
+void BufMgr::unPinFrame(const int frame, const bool dirty) {
+  if(trace.isOn()){
+    trace.record(TRACEUNPIN, bufTable[frame].file,
+		 pageNoOf(bufTable[frame].pageId), dirty ? TRACEDIRTY : 0);
+  }
+  if(dirty){
+    bufTable[frame].dirty = true;
+  }
+  bufTable[frame].pinCnt--;
+}
+
 /*
  * Allocate a new page in the file and bring it into the buffer pool
  * @param *file, the file that we want to allcate a new page in
@@ -273,107 +961,559 @@ const Status BufMgr::unPinPage(File* file, const int PageNo,
  */
 
 const Status BufMgr::allocPage(File* file, int& pageNo, Page*& page)  {
-  // TODO: Implement this method by looking at the description in the writeup.
   int pn = -1; // new allocated page number by file system  
-  int fm = -1; // we try to get a new frame number by calling allocBuf
+  uint64_t start = latency.start();
   if(file->allocatePage(pn) != OK){
     //question if we return unixerr when allocatePage failed
     return UNIXERR;
-  }else{    
-  
-    //successfully allocate a new page in a file
-    //set() frame in buffer pool
-    Status tmp = allocBuf(fm);
-    if(tmp == OK){
-      //we successfully allocate a frame in the buffer pool
-      //set this entry
-      bufTable[fm].Set(file, pn);
-      //we load this into the actual buffer pool entry
-      if(file->readPage(pn, &bufPool[fm]) != OK){
-	return UNIXERR;
+  }
+  //successfully allocate a new page in a file
+  Status status = pinNewPage(file, pn, page);
+  if(status != OK){
+    return status;
+  }
+  //return the pageNo
+  pageNo = pn;
+  latency.record(ALLOCPAGE, start);
+  return OK;
+}
+
+/*
+ * Allocate n consecutive pages in the file, with a single change to its
+ * header, and bring them into the buffer pool
+ * @param *file, the file to allocate the pages in
+ *        n, the number of pages, at most the number of frames
+ *        firstPageNo, returns the page number of the first page; the
+ *        others follow it
+ *        pages, returns the pointers to the n frames, all pinned
+ * @return OK on success
+ *         BADPAGENO if n is below 1, or too many pages in a row for the
+ *         file (see File::allocatePages)
+ *         UNIXERR if a Unix error occurred
+ *         BUFFEREXCEEDED if n is more than the frames or they are pinned
+ *         HASHTBLERROR if a hash table error occurred; the pages stay
+ *         allocated in the file
+ *         on any other error the file is left as it was
+ */
+const Status BufMgr::allocPages(File* file, const int n, int& firstPageNo,
+				Page* pages[]) {
+  uint64_t start = latency.start();
+  if(n < 1){
+    return BADPAGENO;
+  }
+  //claim the n frames before the file is changed.  The pages are not
+  //known yet, so the policy gets no hint of them
+  vector<int> frames;
+  Status status = allocBufs(frames, vector<PageId>(n, 0));
+  if(status != OK){
+    return status;
+  }
+  int pn = -1;
+  if((status = file->allocatePages(n, pn)) != OK){
+    for(int i = 0; i < n; i++){
+      releaseBuf(frames[i]);
+    }
+    return status == BADPAGENO ? status : UNIXERR;
+  }
+  for(int i = 0; i < n; i++){
+    if((status = pinNewPage(file, pn + i, pages[i], frames[i])) != OK){
+      //pinNewPage() released its frame
+      for(int j = 0; j < i; j++){
+	unPinPage(file, pn + j, false);
       }
-      else{
-	//successfully read into the actual buffer pool
-	//insert into hashTable
-	Status tmp1 = hashTable->insert(file, pn, fm);
-	if(tmp1 == OK){
-	  //insertion into hashtable successful
-	  //return the pageNo
-	  pageNo = pn;
-	  //return the page pointer
-	  page = (bufPool+fm);
-	}else{
-	  //hash table err
-	  return tmp1;
-	}
+      for(int j = i + 1; j < n; j++){
+	releaseBuf(frames[j]);
       }
+      return status;
     }
-    else{
+  }
+  firstPageNo = pn;
+  latency.record(ALLOCPAGE, start);
+  return OK;
+}
+
+/*
+ * Bring a page just allocated in the file into the buffer pool, pinned.
+ * The page is not read but zeroed in its frame, which is dirty, so it
+ * costs no I/O until it is written back.
+ * @param *file, the file of the page
+ *        pageNo, the page
+ *        page, returns the pointer to its frame
+ *        frame, a frame claimed from allocBuf() or allocBufs() for the
+ *        page, or -1 to get one here
+ * @return as allocPage()
+ */
+const Status BufMgr::pinNewPage(File* file, const int pageNo, Page*& page,
+				const int frame) {
+  int fm = frame; // we try to get a new frame number by calling allocBuf
+  PageId id = pageIdOf(file, pageNo);
+  if(fm < 0){
+    Status tmp = allocBuf(fm, id);
+    if(tmp != OK){
       //unix error or bufferexceeded 
       return tmp;
     }
   }
+  //insert into hashTable and set this entry
+  bool found;
+  Status tmp1 = installPage(file, id, fm, found);
+  if(tmp1 != OK){
+    //hash table err
+    return tmp1;
+  }
+  if(!found){
+    //a new page is all zeros, so there is nothing to read: zero the
+    //frame and let the page reach the file when it is written back
+    memset(&bufPool[fm], 0, sizeof(Page));
+    bufTable[fm].dirty = true;
+    bufTable[fm].unclaim(1);
+  }
+  //return the page pointer
+  page = (bufPool+fm);
+  trace.record(TRACEALLOC, file, pageNo);
+  curve.record(id);
   return OK;
 }
 
+/*
+ * allocPage() pinning the new page through a handle
+ * @param *file, &pageNo as for allocPage()
+ *        &handle returns the pin; whatever it pinned before is released
+ * @return as allocPage()
+ */
+const Status BufMgr::allocPage(File* file, int& pageNo, PageHandle& handle) {
+  handle.release();
+  Page* page;
+  Status status = allocPage(file, pageNo, page);
+  if(status == OK){
+    handle.set(this, page - bufPool, pageNo);
+  }
+  return status;
+}
+
+// the frames of a run of consecutive pages that prefetch() reads with
+// one request
+struct PrefetchRun : IORequest
+{
+  vector<int> frames;
+  vector<struct iovec> iov;
+};
+
+/*
+ * Start loading pages of a file into the buffer pool without waiting for
+ * them.  Each page that is not in the pool gets a frame and is entered in
+ * the page table right away; the frame stays claimed until its page has
+ * been read, so a readPage() for it in the meantime waits for that read
+ * instead of reading the page again.  The pages are read by the I/O
+ * engine, each run of consecutive pages with one request and all runs at
+ * the same time.  Prefetched pages are not pinned.
+ * @param *file, the file to read from
+ *        pageNos, the pages to read
+ *        n, the number of pages in pageNos
+ * @return OK on success
+ *         BUFFEREXCEEDED if all frames are pinned; the remaining pages are
+ *         not prefetched
+ *         UNIXERR if a dirty page could not be written back
+ *         HASHTBLERROR if a hash table error occurred
+ */
+const Status BufMgr::prefetch(File* file, const int pageNos[], const int n) {
+  vector<int> frames;
+  Status status = OK;
+  for(int i = 0; i < n && status == OK; i++){
+    PageId id = pageIdOf(file, pageNos[i]);
+    //skip pages in the pool or on their way; the frames claimed here
+    //are not read yet, so prefetch() must never wait for a claim
+    BufPartition& part = partition(id);
+    int frame = -1;
+    part.latch.lock_shared();
+    bool present = part.table->lookup(id, frame) == OK;
+    part.latch.unlock_shared();
+    if(present){
+      continue;
+    }
+    if((status = allocBuf(frame, id)) != OK){
+      break;
+    }
+    bool found;
+    if(installPage(file, id, frame, found, false) != OK){
+      status = HASHTBLERROR;
+      break;
+    }
+    if(!found){
+      frames.push_back(frame);
+    }
+  }
+  //one request per run of consecutive pages
+  sort(frames.begin(), frames.end(), [this](int a, int b) {
+      return bufTable[a].pageId < bufTable[b].pageId;
+    });
+  vector<IORequest*> reqs;
+  for(size_t i = 0; i < frames.size(); ){
+    size_t j = i + 1;
+    while(j < frames.size() && j - i < (size_t) IOMAXPAGES &&
+	  bufTable[frames[j]].pageId == bufTable[frames[j - 1]].pageId + 1){
+      j++;
+    }
+    PrefetchRun* run = new PrefetchRun;
+    run->frames.assign(frames.begin() + i, frames.begin() + j);
+    run->iov.resize(j - i);
+    for(size_t k = 0; k < j - i; k++){
+      run->iov[k].iov_base = &bufPool[run->frames[k]];
+      run->iov[k].iov_len = sizeof(Page);
+    }
+    run->done = prefetchDone;
+    run->arg = this;
+    if(file->ioRequest(*run, false, pageNoOf(bufTable[frames[i]].pageId),
+		       &run->iov[0], j - i, &latency) == OK){
+      reqs.push_back(run);
+    } else {
+      prefetchDone(run);
+    }
+    i = j;
+  }
+  if(!reqs.empty()){
+    io->submit(&reqs[0], reqs.size());
+  }
+  return status;
+}
+
+/*
+ * Completion of a prefetch() read: give up the claims of the frames that
+ * were read.  A page that could not be read is removed from the pool
+ * again, so readers waiting for it read it themselves and see the error.
+ * @param req, the PrefetchRun; deleted
+ */
+void BufMgr::prefetchDone(IORequest* req) {
+  PrefetchRun* run = static_cast<PrefetchRun*>(req);
+  BufMgr* mgr = (BufMgr*) req->arg;
+  size_t read = req->result > 0 ? req->result / sizeof(Page) : 0;
+  for(size_t k = 0; k < run->frames.size(); k++){
+    if(k < read){
+      mgr->bufStats.diskreads++;
+      mgr->metrics.countId(fileIdOf(mgr->bufTable[run->frames[k]].pageId),
+			   READS);
+      mgr->bufTable[run->frames[k]].unclaim(0);
+    } else {
+      mgr->releaseBuf(run->frames[k]);
+    }
+  }
+  delete run;
+}
+
 /*
  * dipose a page in the buffer pool and in the file
  * @param *file, the file that contains the page needs to be diposed
  *        PageNo, the page number within the file that needs to be diposed
  * @return OK on success
- *         HASHNOTFOUND if the page is not in the buffer pool hash table
+ *         PAGEPINNED if the page is still pinned in the buffer pool
  *         UNIXERR on dispose failure in the file
  */
 const Status BufMgr::disposePage(File* file, const int pageNo) {
-  // TODO: Implement this method by looking at the description in the writeup.
-  int frame;
-  Status lookuphashtbl = hashTable->lookup(file, pageNo, frame);
-  if(lookuphashtbl == OK){
-    //clear the frame in the bufTable
-    bufTable[frame].Clear();
-    //no need error checking cuz we have found the page
-    hashTable->remove(file,pageNo);
-    //OK, unixerrr or badpageNo.
-    return file->disposePage(pageNo);
-  }else{
-    //hash not found
-    return lookuphashtbl;
+  PageId id = pageIdOf(file, pageNo);
+  BufPartition& part = partition(id);
+  while(1){
+    int frame;
+    part.latch.lock();
+    if(part.table->lookup(id, frame) != OK){
+      //not in the buffer pool, only the file has to be told
+      part.latch.unlock();
+      break;
+    }
+    BufDesc* desc = &bufTable[frame];
+    if(desc->claim()){
+      //clear the frame in the bufTable
+      //no need error checking cuz we have found the page
+      part.table->remove(id);
+      desc->Clear();
+      desc->unclaim(0);
+      part.latch.unlock();
+      policy->dropped(frame);
+      break;
+    }
+    int cnt = desc->pinCnt;
+    part.latch.unlock();
+    if(cnt > 0){
+      return PAGEPINNED;
+    }
+    //the frame is being written back, which needs our partition latch
+    //to finish (latch order); let it and look again
+    metrics.count(file, PINWAITS);
+    this_thread::yield();
   }
-  return OK;
+  //OK, unixerrr or badpageNo.
+  Status status = file->disposePage(pageNo);
+  if(status == OK){
+    trace.record(TRACEDISPOSE, file, pageNo);
+  }
+  return status;
 }
 
 
 /*
  * flush the pages in the buffer pool belonging to the file; write back if dirty
- * clear the frame for the flushed page
+ * clear the frame for the flushed page.  The dirty pages are written in page
+ * order, consecutive ones with a single call, and then the file's header
+ * page if it changed (see File::flushHeader()).
  * @param *file, the file that contains the page needs to be flushed
  * @return OK on success
- *         PAGEPINNED if the page is pinned in the buffer
- *         UNIXERR on write back failure to the file
+ *         PAGEPINNED if the page is pinned in the buffer; nothing is flushed
+ *         UNIXERR on write back failure to the file; the pages stay in the pool
  */
 
 const Status BufMgr::flushFile(const File* file) {
-  // TODO: Implement this method by looking at the description in the writeup.
-  for(int i = 0; i < numBufs; i++){
-    if(bufTable[i].file == file){
-      if(bufTable[i].pinCnt > 0){
-	return PAGEPINNED;
+  int fileId = file->getId();
+  //claim all frames of the file first
+  vector<int> mine;
+  Status status = OK;
+  for(int i = 0; i < numBufs && status == OK; i++){
+    BufDesc* desc = &bufTable[i];
+    //wait for other threads working on the frame, but fail on pins
+    bool claimed = false;
+    while(desc->valid && fileIdOf(desc->pageId) == fileId){
+      if((claimed = desc->claim())){
+	break;
+      }
+      if(desc->pinCnt > 0){
+	status = PAGEPINNED;
+	break;
       }
-      if(bufTable[i].dirty){
-	//write back
-	Status writest = bufTable[i].file->writePage(bufTable[i].pageNo, &bufPool[i]);
-	if(writest == OK){
-	hashTable->remove(file, bufTable[i].pageNo);
-	bufTable[i].Clear();
-	}else{
-	  return writest;
+      metrics.count(file, PINWAITS);
+      this_thread::yield();
+    }
+    if(!claimed){
+      continue;
+    }
+    if(!desc->valid || fileIdOf(desc->pageId) != fileId){
+      desc->unclaim(0);
+      continue;
+    }
+    mine.push_back(i);
+  }
+  if(status == OK){
+    uint64_t dirty = 0;
+    for(size_t k = 0; k < mine.size(); k++){
+      dirty += bufTable[mine[k]].dirty ? 1 : 0;
+    }
+    status = writeBack(mine);
+    if(status == OK){
+      metrics.count(file, FLUSHWRITES, dirty);
+    }
+  }
+  for(size_t k = 0; k < mine.size(); k++){
+    int i = mine[k];
+    BufDesc* desc = &bufTable[i];
+    if(status == OK){
+      //clean pages are dropped as well: the file object goes away when the
+      //file is closed and must not be found in the page table afterwards
+      BufPartition& part = partition(desc->pageId);
+      part.latch.lock();
+      part.table->remove(desc->pageId);
+      desc->Clear();
+      part.latch.unlock();
+      policy->dropped(i);
+    }
+    desc->unclaim(0);
+  }
+  if(status == OK){
+    status = file->flushHeader();
+  }
+  if(status == OK){
+    trace.record(TRACEFLUSH, file, 0);
+  }
+  return status;
+}
+
+/*
+ * Change the number of frames of the buffer pool while it is in use.
+ * Growing first makes the page table big enough for the new frames, one
+ * partition at a time so that only lookups in that partition wait for the
+ * rehash, and then hands the frames to the replacement policy.  Shrinking
+ * evicts the pages in frames frames..numBufs-1, writing the dirty ones
+ * back and waiting up to RESIZEWAIT milliseconds for pinned ones, and
+ * gives the memory of the frames back to the kernel.  The frames given up
+ * stay claimed, so that nothing finds or replaces them, until a resize
+ * adds them again.  Lookups, reads and evictions go on meanwhile.
+ * @param frames, the new number of frames
+ * @return OK on success
+ *         BADBUFFER if frames is below 1 or above getMaxBufs()
+ *         PAGEPINNED if a page stayed pinned; the pool keeps its size,
+ *         the pages evicted so far are gone from it
+ *         UNIXERR if a dirty page could not be written back; as above
+ */
+const Status BufMgr::resize(const int frames) {
+  lock_guard<mutex> guard(resizeLatch);
+  if(frames < 1 || frames > maxBufs){
+    return BADBUFFER;
+  }
+  int old = numBufs;
+  if(frames >= old){
+    //same sizing as the constructor does
+    int htsize = ((int) (frames * 1.2)) / numParts + 1;
+    for(int i = 0; i < numParts; i++){
+      parts[i].latch.lock();
+      parts[i].table->reserve(htsize);
+      parts[i].latch.unlock();
+    }
+    if(!poolLazy){
+      touchPool(old, frames);
+    }
+    //the policy learns about the frames while they are still claimed
+    policy->resize(frames);
+    numBufs = frames;
+    for(int i = old; i < frames; i++){
+      bufTable[i].unclaim(0);
+    }
+    return OK;
+  }
+  //claim the frames to give up and evict their pages, in passes over
+  //those still pinned.  The policy may still propose them, but nobody
+  //else gets them once they are claimed.  Only empty frames stay claimed
+  //between passes: a reader that claimed a victim may be waiting for a
+  //page in one of our frames, and we for its victim.
+  vector<int> retired;
+  vector<bool> gone(old - frames, false), written(old - frames, false);
+  Status status = OK;
+  chrono::steady_clock::time_point deadline = chrono::steady_clock::now()
+    + chrono::milliseconds(RESIZEWAIT);
+  while(status == OK && (int) retired.size() < old - frames){
+    vector<int> mine, dirty;
+    for(int i = frames; i < old; i++){
+      if(!gone[i - frames] && bufTable[i].claim()){
+	mine.push_back(i);
+	if(bufTable[i].valid && bufTable[i].dirty){
+	  dirty.push_back(i);
+	  written[i - frames] = true;
 	}
       }
     }
+    status = writeBack(dirty);
+    for(size_t k = 0; k < mine.size(); k++){
+      BufDesc* desc = &bufTable[mine[k]];
+      if(status != OK){
+	desc->unclaim(0);
+	continue;
+      }
+      if(desc->valid){
+	metrics.count(desc->file, written[mine[k] - frames] ? EVICTDIRTY : EVICTCLEAN);
+	BufPartition& part = partition(desc->pageId);
+	part.latch.lock();
+	part.table->remove(desc->pageId);
+	desc->Clear();
+	part.latch.unlock();
+	policy->evicted(mine[k]);
+      }
+      retired.push_back(mine[k]);
+      gone[mine[k] - frames] = true;
+    }
+    if(status == OK && (int) retired.size() < old - frames){
+      if(chrono::steady_clock::now() > deadline){
+	status = PAGEPINNED;
+      }
+      this_thread::yield();
+    }
+  }
+  if(status != OK){
+    //the frames emptied so far go back to the pool
+    for(size_t k = 0; k < retired.size(); k++){
+      bufTable[retired[k]].unclaim(0);
+    }
+    return status;
+  }
+  policy->resize(frames);
+  numBufs = frames;
+  //give back the pages that only the frames given up used
+  size_t start = ((size_t) frames * sizeof(Page) + poolPage - 1) & ~(poolPage - 1);
+  size_t end = min(poolBytes, ((size_t) old * sizeof(Page) + poolPage - 1)
+		   & ~(poolPage - 1));
+  if(start < end){
+    madvise((char*) bufPool + start, end - start, MADV_DONTNEED);
   }
   return OK;
 }
 
+/*
+ * Size the pool by its miss-ratio curve: the smallest pool, of at most
+ * getMaxBufs() frames, that gets within slack of the hit ratio of the
+ * largest.  The curve has to be enabled for some time first.
+ * @param slack, the hit ratio that may be given up for fewer frames
+ * @return as resize(); OK without resizing if the curve is empty
+ */
+const Status BufMgr::autoSize(const double slack) {
+  if(curve.references() == 0){
+    return OK;
+  }
+  return resize(curve.recommend(maxBufs, slack));
+}
+
+/*
+ * Start the background writer thread, unless it is running already
+ * @param target, the number of frames next in line for replacement that
+ *        are kept clean; 0 picks an eighth of the pool
+ */
+void BufMgr::startWriter(const int target) {
+  lock_guard<mutex> guard(writerLatch);
+  if(writerOn){
+    return;
+  }
+  writerTarget = target > 0 ? target : max(1, numBufs / 8);
+  writerStop = false;
+  writerOn = true;
+  writer = thread(&BufMgr::writerLoop, this);
+}
+
+/*
+ * Stop the background writer thread and wait for it to finish its round
+ */
+void BufMgr::stopWriter() {
+  {
+    lock_guard<mutex> guard(writerLatch);
+    if(!writerOn){
+      return;
+    }
+    writerStop = true;
+  }
+  writerWake.notify_one();
+  writer.join();
+  lock_guard<mutex> guard(writerLatch);
+  writerOn = false;
+}
+
+/*
+ * Body of the background writer: every WRITERDELAY ms, or when allocBuf()
+ * had to write a page itself, clean the frames the replacement policy
+ * will hand out next.  The dirty ones nobody is using are claimed, like
+ * allocBuf() does, so the pages cannot change meanwhile, and written back
+ * together.  Errors are left for allocBuf() to run into and report.
+ */
+void BufMgr::writerLoop() {
+  vector<int> frames, mine;
+  unique_lock<mutex> lock(writerLatch);
+  while(!writerStop){
+    lock.unlock();
+    policy->nextVictims(frames, writerTarget);
+    mine.clear();
+    for(size_t i = 0; i < frames.size(); i++){
+      BufDesc* desc = &bufTable[frames[i]];
+      if(!desc->dirty || !desc->claim()){
+	continue;
+      }
+      if(desc->valid && desc->dirty){
+	mine.push_back(frames[i]);
+      } else {
+	desc->unclaim(0);
+      }
+    }
+    writeBack(mine);
+    for(size_t i = 0; i < mine.size(); i++){
+      bufTable[mine[i]].unclaim(0);
+    }
+    lock.lock();
+    if(!writerStop){
+      writerWake.wait_for(lock, chrono::milliseconds(WRITERDELAY));
+    }
+  }
+}
+
 /*
  * For debug use; print the status of each buffer pool frame
  */
@@ -387,17 +1527,46 @@ void BufMgr::printSelf(void)
   for (int i=0; i<numBufs; i++) {
     tmpbuf = &(bufTable[i]);
     cout << i << "\t" << (char*)(&bufPool[i]) 
-	 << "actual page num " << tmpbuf->pageNo
+	 << "actual page num " << pageNoOf(tmpbuf->pageId)
 	 << "\tpinCnt: " << tmpbuf->pinCnt;
     
     if (tmpbuf->valid == true)
       cout << "\tvalid\n";
-    if (tmpbuf->refbit == true)
-      cout << "\tref\n";
-    else
-      cout << "\tnot ref\n";
     cout << endl;
   };
 }
 
 
+
+//----------------------------------------
+// PageHandle
+//----------------------------------------
+
+void PageHandle::set(BufMgr* mgr, const int frame, const int pageNo)
+{
+  this->mgr = mgr;
+  this->frame = frame;
+  this->pageNo = pageNo;
+  dirty = false;
+}
+
+PageHandle& PageHandle::operator=(PageHandle&& other) noexcept
+{
+  if (this != &other) {
+    release();
+    mgr = other.mgr;
+    frame = other.frame;
+    pageNo = other.pageNo;
+    dirty = other.dirty;
+    other.mgr = NULL;
+  }
+  return *this;
+}
+
+void PageHandle::release()
+{
+  if (mgr) {
+    mgr->unPinFrame(frame, dirty);
+    mgr = NULL;
+  }
+}
@@ -1,89 +1,308 @@
 #ifndef BUF_H
 #define BUF_H
 
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
 #include "db.h"
+#include "bufMetrics.h"
+#include "bufTrace.h"
+#include "bufCurve.h"
 // define if debug output wanted
 //#define DEBUGBUF
 
+// identity of a page in the buffer pool: the file's id (see
+// DB::openFile) in the high and the page number in the low 32 bits.
+// File ids start at 1, so 0 is never a page.
+typedef uint64_t PageId;
+
+inline PageId pageIdOf(const File* file, const int pageNo)
+{
+  return ((PageId) file->getId() << 32) | (uint32_t) pageNo;
+}
+inline int fileIdOf(const PageId id) { return (int) (id >> 32); }
+inline int pageNoOf(const PageId id) { return (int) (uint32_t) id; }
+
 // declarations for buffer pool hash table
+//
+// The fields are atomics because BufHashTbl::peek() reads them without
+// any latch while a writer may be moving entries around; all accesses
+// are relaxed, a reader has to check what it found (see BufMgr::pinPage)
 struct hashBucket
 {
-	File*	file;    // pointer a file object (more on this below)
-	int	pageNo;  // page number within a file
-	int	frameNo; // frame number of page in the buffer pool
-	hashBucket* 	next;	 // next node in the hash table
+	atomic<PageId>	key;     // page in the bucket; 0 if the bucket is empty
+	atomic<int>	frameNo; // frame number of page in the buffer pool
+};
+
+// bucket array of a BufHashTbl; the buckets follow the header
+struct alignas(64) hashSlots
+{
+	unsigned int mask;   // number of buckets - 1 (a power of two)
+	int	shift;       // 64 - log2(number of buckets)
+
+	hashBucket* bucket() { return (hashBucket*) (this + 1); }
+};
+
+
+// Epoch based reclamation for memory that lock-free readers may still be
+// looking at.  Readers bracket their accesses with enter()/exit(); memory
+// handed to retire() is freed once every reader that might have seen it
+// has left.
+class Epoch
+{
+public:
+    // start a read-side section; returns false if the thread could not
+    // get an epoch slot, in which case it has to latch instead
+    static bool enter();
+    static void exit();   // end a read-side section
+    // free(mem) as soon as no reader can see it anymore
+    static void retire(void* mem);
 };
 
 
 // hash table to keep track of pages in the buffer pool
+//
+// Open addressing with Robin Hood linear probing over one flat,
+// cache-line aligned array of buckets, so a lookup touches one or two
+// cache lines and insert/remove never allocate.  Removal shifts the
+// following entries back instead of leaving tombstones.  The table only
+// reallocates (doubling) if it gets more than 7/8 full, which the sizing
+// done by BufMgr makes rare; the old array is retired through Epoch.
+//
+// insert, remove and lookup must be serialized by the caller (BufMgr
+// uses the partition latch); peek may run concurrently with them.
 class BufHashTbl
 {
 private:
-    int HTSIZE;
-    hashBucket**  ht; // actual hash table
-    int	 hash(const File* file, const int pageNo); // returns value between 0 and HTSIZE-1
+    atomic<hashSlots*> slots;  // actual hash table
+    int  count;          // number of entries in the table
+
+    // home bucket of a page: high bits of its hash
+    static unsigned int home(const hashSlots* s, const PageId key)
+    {
+      return hash(key) >> s->shift;
+    }
+    // distance of the entry in bucket i from its home bucket
+    static unsigned int probeDist(hashSlots* s, const unsigned int i)
+    {
+      return (i - home(s, s->bucket()[i].key.load(memory_order_relaxed)))
+	& s->mask;
+    }
+    static hashSlots* allocTable(const int buckets);
+    // search s for key
+    static Status probe(hashSlots* s, const PageId key, int& frameNo);
+    void grow(const unsigned int buckets);  // rehash into more buckets
 
 public:
-    BufHashTbl(const int htSize);  // constructor
+    BufHashTbl(const int htSize);  // constructor; sized for htSize entries
     ~BufHashTbl(); // destructor
+
+    // hash of a page; a full 64 bit mix (MurmurHash3's finalizer), so
+    // the high bits pick the bucket and BufMgr can take the partition
+    // from the low bits
+    static uint64_t hash(PageId key)
+    {
+      key ^= key >> 33;
+      key *= 0xff51afd7ed558ccdULL;
+      key ^= key >> 33;
+      key *= 0xc4ceb9fe1a85ec53ULL;
+      key ^= key >> 33;
+      return key;
+    }
 	
-    // insert entry into hash table mapping (file,pageNo) to frameNo;
+    // insert entry into hash table mapping page key to frameNo;
     // returns 0 if OK, HASHTBLERROR if an error occurred
-  Status insert(const File* file, const int pageNo, const int frameNo);
+  Status insert(const PageId key, const int frameNo);
 
-    // Check if (file,pageNo) is currently in the buffer pool (ie. in
+    // Check if page key is currently in the buffer pool (ie. in
     // the hash table).  If so, return corresponding frameNo. else return 
     // HASHNOTFOUND
-  Status lookup(const File* file, const int pageNo, int & frameNo);
+  Status lookup(const PageId key, int & frameNo);
+
+    // lookup without latching, wait-free.  Concurrent writers can make it
+    // miss an entry or return a frame that holds a different page, so
+    // the caller has to verify the frame and fall back to lookup()
+  Status peek(const PageId key, int & frameNo) const;
 
-    // delete entry (file,pageNo) from hash table. REturn OK if page was
+    // delete entry for page key from hash table. REturn OK if page was
     // found.  Else return HASHTBLERROR
-  Status remove(const File* file, const int pageNo);  
+  Status remove(const PageId key);  
+
+    // make room for htSize entries, rehashing now rather than while they
+    // are inserted; serialized like insert
+  void reserve(const int htSize);
 };
 
 
 class BufMgr;  //forward declaration of BufMgr class 
+class BufPolicy;  // replacement policies, see bufPolicy.h
+class IOEngine;   // asynchronous I/O, see ioEngine.h
+struct IORequest;
+
+// replacement policies a BufMgr can be constructed with
+enum ReplPolicy { CLOCK, LRUK, TWOQ, ARC, CLOCKPRO };
 
 // class for maintaining information about buffer pool frames
+//
+// Concurrency: all fields are atomics.  pinCnt doubles as the frame's
+// ownership word: a thread that evicts, writes back or fills a frame
+// first claims it by swapping a pin count of 0 for CLAIMED, and gives it
+// up again with unclaim().  Lookups pin without any latch (tryPin) and
+// back off while the frame is claimed, so the identity (file, pageId,
+// valid) of a frame only changes while it is claimed and is stable for
+// anybody holding a pin.  Entering or removing a frame in the page table
+// additionally needs the exclusive partition latch; a thread holding a
+// partition latch never waits for a claim (latch order is claim first).
 class BufDesc {
     friend class BufMgr;
+    friend class BufPolicy;
 private:
-  File* file;   // pointer to file object
-  int   pageNo; // page within file
+  atomic<File*> file;   // pointer to file object
+  atomic<PageId> pageId; // file id and page within file
   int	frameNo;  // frame # of frame
-  int   pinCnt; // number of times this page has been pinned
-  bool 	dirty;	  // true if dirty;  false otherwise
-  bool 	valid;   // true if page is valid
-  bool  refbit;	 // has this buffer frame been reference recently
+  atomic<int>   pinCnt; // number of times this page has been pinned
+  atomic<bool> 	dirty;	  // true if dirty;  false otherwise
+  atomic<bool> 	valid;   // true if page is valid
+
+  // pinCnt of a claimed frame; stray tryPin()s add to it briefly
+  static const int CLAIMED = -(1 << 30);
+
+  bool claim() {  // take ownership of an unpinned frame
+      int zero = 0;
+      return pinCnt.compare_exchange_strong(zero, CLAIMED);
+  }
+  void unclaim(const int pins) { // give up ownership, leaving pins pins
+      pinCnt.fetch_add(pins - CLAIMED);
+  }
+  bool tryPin() {  // pin unless the frame is claimed
+      if (pinCnt.fetch_add(1) >= 0)
+	return true;
+      pinCnt--;
+      return false;
+  }
 
   void Clear() {  // initialize buffer frame for a new user
-    	pinCnt = 0;
 	file = NULL;
-	pageNo = -1;
+	pageId = 0;
     	dirty = false;
 	valid = false;
   };
 
-  void Set(File* filePtr, int pageNum) { 
+  void Set(File* filePtr, PageId id) { // pins are set by unclaim()
       file = filePtr;
-      pageNo = pageNum;
-      pinCnt = 1;
+      pageId = id;
       dirty = false;
       valid = true;
-      refbit = true;
   }
 
   BufDesc() {
       Clear();
+      pinCnt = 0;
   }
 };
 
 
+// one latch partition of the buffer pool page table; a page belongs to
+// partition BufHashTbl::hash(pageId) % numParts
+struct alignas(64) BufPartition
+{
+  shared_mutex latch;  // shared for latched lookups, exclusive for insert/remove
+  BufHashTbl*  table;  // the pages of this partition
+
+  BufPartition() : table(NULL) {}
+};
+
+// default number of page table partitions
+const int BUFPARTITIONS = 16;
+
+// milliseconds the background writer sleeps between rounds
+const int WRITERDELAY = 10;
+
+// default number of frames in a BufRing
+const int RINGSIZE = 32;
+
+// How the memory of the buffer pool is obtained, flags of BufMgr's
+// poolFlags.  The pool is one anonymous mapping and starts on a page
+// boundary, so frames are aligned as direct I/O needs them.
+const int POOLHUGE = 1;     // transparent huge pages, starting on a huge page
+const int POOLHUGETLB = 2;  // reserved huge pages (MAP_HUGETLB); POOLHUGE
+			    // if there are not enough of them
+const int POOLLAZY = 4;     // fault frames in when first used, not up front
+const size_t HUGEPAGESIZE = 2 << 20;
+
+// The address space of the pool, and its frame descriptors, are set
+// aside for the most frames BufMgr::resize() may grow it to; by default
+// POOLRESERVE times the frames it starts with.  Only the frames in use
+// are backed by memory.
+const int POOLRESERVE = 4;
+
+// milliseconds BufMgr::resize() waits for pages it evicts to be unpinned
+const int RESIZEWAIT = 1000;
+
+
+// The frames a sequential scan reads its pages into.  Passed to
+// readPage(), it makes a scan recycle the same few frames instead of
+// pushing the pages of everybody else out of the pool: a page that is not
+// in the pool replaces the page the ring read size calls ago, unless
+// that frame is pinned or dirty by now, or the policy has given it to
+// another page, and is left to the replacement policy.  At most an eighth of the pool is used, whatever the size.  A
+// ring belongs to one scan (one thread) and one BufMgr.
+class BufRing
+{
+  friend class BufMgr;
+private:
+  int  size;      // number of frames
+  int* frames;    // the frames, -1 until used
+  PageId* pages;  // the page read into each frame
+  int  next;      // slot the next page goes to
+
+public:
+  BufRing(const int size = RINGSIZE);
+  ~BufRing();
+};
+
+
+// A pin on a page in the buffer pool, filled in by the readPage() and
+// allocPage() that take one.  The page is unpinned when the handle is
+// destroyed or release()d, directly on its frame without looking the
+// page up again, and marked dirty if markDirty() was called.  Handles
+// can be moved but not copied; an empty or moved-from handle pins nothing.
+class PageHandle
+{
+  friend class BufMgr;
+private:
+  BufMgr* mgr;     // NULL if the handle pins nothing
+  int     frame;
+  int     pageNo;
+  bool    dirty;
+
+  void set(BufMgr* mgr, const int frame, const int pageNo);
+
+public:
+  PageHandle() : mgr(NULL), frame(-1), pageNo(0), dirty(false) {}
+  PageHandle(PageHandle&& other) noexcept : mgr(NULL) { *this = move(other); }
+  PageHandle& operator=(PageHandle&& other) noexcept;
+  PageHandle(const PageHandle&) = delete;
+  PageHandle& operator=(const PageHandle&) = delete;
+  ~PageHandle() { release(); }
+
+  bool  valid() const { return mgr != NULL; }
+  Page* page() const;
+  int   getPageNo() const { return pageNo; }
+  void  markDirty() { dirty = true; }  // the page is written back some time
+  void  release();  // unpin the page now
+};
+
+
 struct BufStats
 {
-  int accesses;    // Total number of accesses to buffer pool
-  int diskreads;   // Number of pages read from disk (including allocs)
-  int diskwrites;  // Number of pages written back to disk
+  atomic<int> accesses;    // Total number of accesses to buffer pool
+  atomic<int> diskreads;   // Number of pages read from disk (including allocs)
+  atomic<int> diskwrites;  // Number of pages written back to disk
 
   void clear()
     {
@@ -99,35 +318,123 @@ struct BufStats
 
 class BufMgr 
 {
+  friend class PageHandle;
 private:
-  unsigned int 	 clockHand;
-  int   	 numBufs;    	// Number of pages in buffer pool
-  BufHashTbl*    hashTable;  	// hash table mapping (File, page) to frame
+  atomic<int>	 numBufs;    	// Number of pages in buffer pool
+  int		 maxBufs;	// most pages resize() may grow it to
+  mutex		 resizeLatch;	// one resize() at a time
+  bool		 poolLazy;	// frames are faulted in when first used
+  size_t	 poolPage;	// page size of the pool's mapping
+  int		 numParts;	// Number of page table partitions
+  BufPartition*  parts;  	// page table mapping PageId to frame
   BufDesc*	 bufTable;  	// vector of status info, 1 per page
   BufStats	 bufStats;	// buffer pool statistics
+  BufMetrics	 metrics;	// the same and more, per file
+  BufLatency	 latency;	// how long reads, allocations and I/O take
+  BufTrace	 trace;		// the calls made, when tracing
+  BufCurve	 curve;		// hit ratio by pool size, when enabled
+  BufPolicy*	 policy;	// picks the frames to replace
+
+  // background writer, see startWriter()
+  thread	 writer;
+  mutex		 writerLatch;	// protects writerStop
+  condition_variable writerWake;
+  bool		 writerStop;
+  atomic<bool>	 writerOn;
+  int		 writerTarget;	// frames to keep clean ahead of replacement
+  void writerLoop();
+
+  // prefetch reads and write backs, many at a time
+  IOEngine*	 io;
+  static void prefetchDone(IORequest* req);
 
-  const Status allocBuf(int & frame);   // allocate a free frame.  
-  const void releaseBuf(int frame); // return unused frame to end of list
-  void advanceClock()
+  // allocate a free frame for page incoming; on success the caller holds
+  // the frame's claim
+  const Status allocBuf(int & frame, const PageId incoming);
+  // allocBuf() for several pages, writing the dirty victims back together
+  const Status allocBufs(vector<int>& frames, const vector<PageId>& incoming);
+  // allocate the next frame of a scan's ring, like allocBuf()
+  const Status ringBuf(BufRing* ring, int & frame, const PageId incoming);
+  const void releaseBuf(int frame); // return unused frame to the pool
+  // map bufPool for capacity frames, the first bufs faulted in
+  void allocPool(const int bufs, const int capacity, const int flags);
+  void touchPool(const int from, const int to);  // fault in these frames
+  // write the dirty pages among frames, which the caller owns, back to
+  // their files; sorts frames by page
+  const Status writeBack(vector<int>& frames);
+  BufPartition& partition(const PageId id)
   {
-	clockHand = (clockHand + 1) % numBufs;
+	return parts[BufHashTbl::hash(id) % numParts];
   }
+  // pin page id if it is in the buffer pool
+  bool pinPage(const PageId id, int& frame);
+  // pin a page, reading it if it is not in the pool; readPage() without
+  // the statistics
+  const Status fetchPage(File* file, const int PageNo, int& frame,
+			 BufRing* ring);
+  // unPinPage() for a pinned frame, see PageHandle
+  void unPinFrame(const int frame, const bool dirty);
+  // read the pages readPages() did not find in the pool
+  const Status readMisses(File* file, const int pageNos[],
+			  vector<int>& misses, vector<int>& frameOf);
+  // enter a page about to be read into a frame from allocBuf
+  const Status installPage(File* file, const PageId id, int& frame,
+			   bool& found, const bool wait = true);
+  // bring a page just allocated in the file into the pool, pinned, in
+  // a frame from allocBuf or in frame if that is claimed already
+  const Status pinNewPage(File* file, const int pageNo, Page*& page,
+			  const int frame = -1);
 
 
 public:
   Page*	         bufPool;   // actual buffer pool
+  size_t	 poolBytes; // length of its mapping
 
-  BufMgr(const int bufs);
+  // all public methods may be called concurrently from several threads
+  // maxBufs is the most frames resize() may grow the pool to, 0 for
+  // POOLRESERVE * bufs
+  BufMgr(const int bufs, const int partitions = BUFPARTITIONS,
+	 const ReplPolicy replacement = CLOCK, const int poolFlags = 0,
+	 const int maxBufs = 0);
   ~BufMgr();
 
-  const Status readPage(File* file, const int PageNo, Page*& page);
+  const Status readPage(File* file, const int PageNo, Page*& page,
+			BufRing* ring = NULL);
   const Status unPinPage(File* file, const int PageNo, const bool dirty);
+  // readPage() and unPinPage() for n pages of a file at once
+  const Status readPages(File* file, const int pageNos[], Page* pages[],
+			 const int n);
+  const Status unPinPages(File* file, const int pageNos[], const int n,
+			  const bool dirty);
   const Status allocPage(File* file, int& PageNo, Page*& page); 
+  // allocate n consecutive pages and pin them all
+  const Status allocPages(File* file, const int n, int& firstPageNo,
+			  Page* pages[]);
+  // readPage() and allocPage() that pin the page through a handle; what
+  // the handle pinned before is released first
+  const Status readPage(File* file, const int PageNo, PageHandle& handle,
+			BufRing* ring = NULL);
+  const Status allocPage(File* file, int& PageNo, PageHandle& handle);
                         // allocates a new, empty page 
   const Status flushFile(const File* file); // writing out all dirty pages of the file
   const Status disposePage(File* file, const int PageNo); // dispose of page in file
+  // start reading pages into the pool in the background
+  const Status prefetch(File* file, const int pageNos[], const int n);
   void  printSelf();
 
+  // grow or shrink the pool to frames frames while it is in use, see
+  // buf.cpp; getNumBufs() is the current size, getMaxBufs() the limit
+  const Status resize(const int frames);
+  int   getNumBufs() const { return numBufs; }
+  int   getMaxBufs() const { return maxBufs; }
+
+  // start a thread that writes dirty pages back before the replacement
+  // policy gets to them, so that allocBuf() finds clean victims and
+  // readPage() does not wait for writes.  target is the number of frames
+  // next in line for replacement it keeps clean, 0 for an eighth of the pool
+  void  startWriter(const int target = 0);
+  void  stopWriter();
+
   const BufStats & getBufStats() const // get buffer pool usage
   {
 	return bufStats;
@@ -136,7 +443,54 @@ public:
   {
 	bufStats.clear();
   }
+
+  // counters per file, see BufMetrics; getMetrics().dump(cout) prints them
+  const BufMetrics & getMetrics() const
+  {
+	return metrics;
+  }
+  void clearMetrics()
+  {
+	metrics.clear();
+  }
+  // latency histograms, see BufLatency; off until enabled, e.g.
+  // getLatency().enable(true), and getLatency().dump(cout) prints them
+  BufLatency & getLatency()
+  {
+	return latency;
+  }
+  // record the calls made to the buffer manager in a trace file (see
+  // BufTrace), until stopTrace(); replay plays such a trace back
+  const Status startTrace(const char* path)
+  {
+	return trace.start(path);
+  }
+  const Status stopTrace()
+  {
+	return trace.stop();
+  }
+  // the hit ratio the pool would have at other sizes, see BufCurve; off
+  // until enabled, e.g. getCurve().enable(true), and
+  // getCurve().dump(cout, frames) prints it up to frames frames
+  BufCurve & getCurve()
+  {
+	return curve;
+  }
+  // resize() the pool to the size getCurve() recommends, up to
+  // getMaxBufs(); nothing happens if the curve recorded nothing
+  const Status autoSize(const double slack = 0.01);
+  // File::close() tells the buffer manager, after flushFile()
+  void fileClosed(const File* file)
+  {
+	metrics.closeFile(file);
+	trace.closeFile(file);
+  }
 };
 
+inline Page* PageHandle::page() const
+{
+  return mgr ? &mgr->bufPool[frame] : NULL;
+}
+
 #endif
 
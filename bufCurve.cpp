@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <iomanip>
+#include "bufCurve.h"
+
+
+BufCurve::BufCurve(const int samples)
+  : enabled(false), threshold(CURVESCALE), samples(max(1, samples))
+{
+  clear();
+}
+
+void BufCurve::clear()
+{
+  lock_guard<mutex> guard(latch);
+  threshold = CURVESCALE;
+  now = 0;
+  tree.assign(4 * samples + 1, 0);
+  marked = 0;
+  last.clear();
+  byHash.clear();
+  for (int b = 0; b < LATENCYBUCKETS; b++)
+    hist[b] = 0;
+  total = 0;
+}
+
+void BufCurve::mark(uint64_t t, const int delta)
+{
+  for (; t < tree.size(); t += t & -t)
+    tree[t] += delta;
+  marked += delta;
+}
+
+int BufCurve::markedUpTo(uint64_t t) const
+{
+  int n = 0;
+  for (; t > 0; t -= t & -t)
+    n += tree[t];
+  return n;
+}
+
+void BufCurve::forget(const uint64_t id)
+{
+  auto it = last.find(id);
+  mark(it->second, -1);
+  last.erase(it);
+}
+
+// the tree has run out of times: give the pages times 1, 2, ... in the
+// order of their last references, which keeps all distances
+void BufCurve::renumber()
+{
+  vector<pair<uint64_t, uint64_t> > order;  // (time, page)
+  for (auto it = last.begin(); it != last.end(); ++it)
+    order.push_back(make_pair(it->second, it->first));
+  sort(order.begin(), order.end());
+  tree.assign(max((size_t) 4 * samples, 2 * order.size()) + 1, 0);
+  marked = 0;
+  for (size_t i = 0; i < order.size(); i++) {
+    last[order[i].second] = i + 1;
+    mark(i + 1, 1);
+  }
+  now = order.size();
+}
+
+void BufCurve::add(const uint64_t id, const uint32_t h)
+{
+  lock_guard<mutex> guard(latch);
+  // the threshold may have come down since the caller looked
+  if (h >= threshold)
+    return;
+  if (now + 1 >= tree.size())
+    renumber();
+  total++;
+  auto it = last.find(id);
+  if (it == last.end()) {
+    byHash.insert(make_pair(h, id));
+  } else {
+    // the sampled pages referenced since, scaled up to all pages
+    double rate = (double) threshold / CURVESCALE;
+    int d = marked - markedUpTo(it->second);
+    hist[LatencyHistogram::bucketOf((uint64_t) (d / rate))]++;
+    mark(it->second, -1);
+  }
+  last[id] = ++now;
+  mark(now, 1);
+  if ((int) last.size() <= samples)
+    return;
+  // sample fewer pages: lower the threshold to the highest hash, and
+  // count what was counted at the old rate for less
+  uint32_t lower = byHash.rbegin()->first;
+  while (!byHash.empty() && byHash.rbegin()->first >= lower) {
+    forget(byHash.rbegin()->second);
+    byHash.erase(--byHash.end());
+  }
+  double scale = (double) lower / threshold;
+  for (int b = 0; b < LATENCYBUCKETS; b++)
+    hist[b] *= scale;
+  total *= scale;
+  threshold = lower;
+}
+
+// the references with a reuse distance below frames; a bucket frames
+// falls in counts in proportion
+double BufCurve::hitsBelow(const int frames) const
+{
+  double hits = 0;
+  for (int b = 0; b < LATENCYBUCKETS; b++) {
+    if (hist[b] == 0)
+      continue;
+    uint64_t low = b == 0 ? 0 : LatencyHistogram::highest(b - 1) + 1;
+    uint64_t high = LatencyHistogram::highest(b);
+    if (high < (uint64_t) frames)
+      hits += hist[b];
+    else if (low < (uint64_t) frames)
+      hits += hist[b] * (frames - low) / (high - low + 1);
+    else
+      break;
+  }
+  return hits;
+}
+
+double BufCurve::hitRatio(const int frames) const
+{
+  lock_guard<mutex> guard(latch);
+  return total > 0 ? hitsBelow(frames) / total : 0;
+}
+
+double BufCurve::references() const
+{
+  lock_guard<mutex> guard(latch);
+  return total * CURVESCALE / threshold;
+}
+
+// maxFrames if nothing was recorded; the curve only rises, so a binary
+// search finds the size
+int BufCurve::recommend(const int maxFrames, const double slack) const
+{
+  lock_guard<mutex> guard(latch);
+  if (total == 0 || maxFrames <= 1)
+    return max(1, maxFrames);
+  double target = hitsBelow(maxFrames) / total - slack;
+  int low = 1, high = maxFrames;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (hitsBelow(mid) / total >= target)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  return low;
+}
+
+// In steps of 1/256 of the frames: the next frames go to the pool that
+// gains the most hits per frame from them, over any number of steps, so a
+// pool whose curve only rises after a flat stretch (a loop over more
+// pages than it has frames) gets all the frames it needs at once or none.
+// Frames that buy no pool any hits are shared out evenly.
+void BufCurve::divide(const vector<const BufCurve*>& curves, const int frames,
+		      const int minFrames, vector<int>& sizes)
+{
+  int n = curves.size();
+  sizes.assign(n, minFrames);
+  int left = frames - n * minFrames;
+  if (n == 0 || left <= 0)
+    return;
+  int step = max(1, left / 256);
+  int steps = left / step;
+  // hits[i][m], the hits of pool i with m more steps
+  vector<vector<double> > hits(n, vector<double>(steps + 1));
+  for (int i = 0; i < n; i++) {
+    double refs = curves[i]->references();
+    for (int m = 0; m <= steps; m++)
+      hits[i][m] = refs * curves[i]->hitRatio(minFrames + m * step);
+  }
+  vector<int> at(n, 0);
+  while (steps > 0) {
+    int best = -1, bestSteps = 0;
+    double bestGain = 0;
+    for (int i = 0; i < n; i++)
+      for (int m = 1; m <= steps; m++) {
+	double gain = (hits[i][at[i] + m] - hits[i][at[i]]) / m;
+	if (gain > bestGain) {
+	  best = i;
+	  bestSteps = m;
+	  bestGain = gain;
+	}
+      }
+    if (best < 0)
+      break;
+    at[best] += bestSteps;
+    sizes[best] += bestSteps * step;
+    steps -= bestSteps;
+    left -= bestSteps * step;
+  }
+  for (int i = 0; i < n; i++)
+    sizes[i] += left / n + (i < left % n ? 1 : 0);
+}
+
+void BufCurve::dump(ostream& out, const int maxFrames, const int points,
+		    const bool json) const
+{
+  ios::fmtflags flags = out.flags();
+  streamsize precision = out.precision();
+  out << fixed << setprecision(4);
+  double refs = references();
+  if (json)
+    out << "{\"references\": " << (uint64_t) refs << ", \"curve\": [";
+  else
+    out << "# references " << (uint64_t) refs << endl << setw(10) << "frames"
+	<< ' ' << setw(9) << "hit ratio" << endl;
+  for (int k = 1; k <= points; k++) {
+    int frames = max(1, (int) ((long) maxFrames * k / points));
+    if (json)
+      out << (k > 1 ? ", " : "") << '[' << frames << ", " << hitRatio(frames)
+	  << ']';
+    else
+      out << setw(10) << frames << ' ' << setw(9) << hitRatio(frames) << endl;
+  }
+  if (json)
+    out << "]}" << endl;
+  out.flags(flags);
+  out.precision(precision);
+}
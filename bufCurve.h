@@ -0,0 +1,99 @@
+#ifndef BUFCURVE_H
+#define BUFCURVE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include "bufMetrics.h"
+
+// pages are sampled by a hash of them in [0, CURVESCALE)
+const uint32_t CURVESCALE = 1 << 24;
+
+// most pages a BufCurve samples at a time, by default
+const int CURVESAMPLES = 8192;
+
+// Miss-ratio curve of a buffer pool: for any number of frames, the hit
+// ratio an LRU pool of that size would have had on the pages referenced.
+// The reuse distance of each reference, the number of other pages
+// referenced since the page was last, is measured on a spatial sample of
+// the pages as SHARDS (Waldspurger et al., FAST '15) does: a page is in
+// the sample if its hash is below a threshold, and the distances among
+// sampled pages are scaled up by the sampling rate.  The rate starts at 1
+// and is lowered, dropping the pages hashed highest, whenever more than a
+// fixed number of pages are sampled, so the memory used is bounded
+// however large the database.
+//
+// Off to begin with; record() costs a load when off and a hash when on,
+// and only references to sampled pages take the latch.  Distances are
+// kept in the buckets of a LatencyHistogram, to a sixteenth of their size.
+class BufCurve
+{
+public:
+  BufCurve(const int samples = CURVESAMPLES);
+
+  void enable(const bool on) { enabled.store(on, memory_order_relaxed); }
+  bool isEnabled() const { return enabled.load(memory_order_relaxed); }
+
+  // a reference to page id (a PageId)
+  void record(const uint64_t id)
+  {
+    if (!isEnabled())
+      return;
+    uint32_t h = sampleHash(id);
+    if (h < threshold.load(memory_order_relaxed))
+      add(id, h);
+  }
+  void clear();
+
+  // the fraction of the references recorded that an LRU pool of frames
+  // frames would have found in the pool
+  double hitRatio(const int frames) const;
+  // the number of references recorded, as estimated from the sample
+  double references() const;
+  // the smallest pool of at most maxFrames frames whose hit ratio is
+  // within slack of that of maxFrames frames
+  int recommend(const int maxFrames, const double slack = 0.01) const;
+  // split frames frames among pools whose references the curves
+  // recorded, so that they get the most hits between them; every pool
+  // gets at least minFrames.  sizes returns the frames of each pool.
+  static void divide(const vector<const BufCurve*>& curves, const int frames,
+		     const int minFrames, vector<int>& sizes);
+  // the hit ratio at points pool sizes up to maxFrames, as a table or as
+  // a JSON object {"references": n, "curve": [[frames, ratio], ...]}
+  void dump(ostream& out, const int maxFrames, const int points = 10,
+	    const bool json = false) const;
+
+private:
+  mutable mutex latch;       // protects all below but enabled and threshold
+  atomic<bool> enabled;
+  atomic<uint32_t> threshold;  // pages hashed below are sampled
+  int samples;               // most pages sampled
+  uint64_t now;              // time of the last sampled reference
+  vector<int> tree;          // Fenwick tree over times, 1 at a page's last
+  int marked;                // number of 1s in tree
+  unordered_map<uint64_t, uint64_t> last;  // sampled page to its last time
+  set<pair<uint32_t, uint64_t> > byHash;   // sampled pages by hash
+  double hist[LATENCYBUCKETS]; // references by scaled reuse distance
+  double total;              // all references sampled
+
+  static uint32_t sampleHash(uint64_t id)
+  {
+    // splitmix64's finalizer; not the page table's hash, so the sample
+    // is spread over its partitions
+    id = (id ^ (id >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    id = (id ^ (id >> 27)) * 0x94d049bb133111ebULL;
+    return (uint32_t) (id ^ (id >> 31)) & (CURVESCALE - 1);
+  }
+  void add(const uint64_t id, const uint32_t h);
+  void mark(uint64_t t, const int delta);  // tree[t] += delta
+  int  markedUpTo(uint64_t t) const;        // 1s at times 1..t
+  void forget(const uint64_t id);
+  void renumber();        // times 1..number of pages, in the same order
+  double hitsBelow(const int frames) const;  // unscaled
+};
+
+#endif
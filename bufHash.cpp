@@ -5,118 +5,278 @@
 #include <fcntl.h>
 #include <iostream>
 #include <stdio.h>
+#include <vector>
 #include "page.h"
 #include "buf.h"
 
+// epoch based reclamation
+
+// Every thread that reads gets a slot in which it announces the global
+// epoch it started in (0 while it is not reading).  retire() stamps the
+// memory with the epoch before advancing it; a reader that announced a
+// later epoch started after the memory was unlinked and cannot see it.
+
+static const int EPOCHSLOTS = 512;
+
+struct alignas(64) EpochSlot
+{
+  atomic<unsigned long> epoch;  // epoch the reader started in; 0 if idle
+  atomic<bool> used;            // slot owned by a thread
+};
+
+static EpochSlot epochSlots[EPOCHSLOTS];
+static atomic<unsigned long> globalEpoch(1);
+static mutex retireLatch;       // protects retired
+static vector<pair<unsigned long, void*> > retired;
+
+// gives the thread's slot back when the thread exits
+struct EpochThread
+{
+  int slot;
+  EpochThread() : slot(-1) {}
+  ~EpochThread()
+  {
+    if (slot >= 0)
+      epochSlots[slot].used = false;
+  }
+};
+
+static thread_local EpochThread epochThread;
+
+bool Epoch::enter()
+{
+  int slot = epochThread.slot;
+  if (slot < 0) {
+    for (int i = 0; i < EPOCHSLOTS && slot < 0; i++) {
+      bool unused = false;
+      if (epochSlots[i].used.compare_exchange_strong(unused, true))
+	slot = i;
+    }
+    if (slot < 0)
+      return false;
+    epochThread.slot = slot;
+  }
+  epochSlots[slot].epoch = globalEpoch.load();
+  return true;
+}
+
+void Epoch::exit()
+{
+  epochSlots[epochThread.slot].epoch = 0;
+}
+
+void Epoch::retire(void* mem)
+{
+  lock_guard<mutex> guard(retireLatch);
+  retired.push_back(make_pair(globalEpoch.fetch_add(1), mem));
+
+  // everything retired before the oldest running reader started can go
+  unsigned long oldest = globalEpoch.load();
+  for (int i = 0; i < EPOCHSLOTS; i++) {
+    unsigned long e = epochSlots[i].epoch;
+    if (e != 0 && e < oldest)
+      oldest = e;
+  }
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < retired.size(); i++) {
+    if (retired[i].first < oldest)
+      free(retired[i].second);
+    else
+      retired[kept++] = retired[i];
+  }
+  retired.resize(kept);
+}
+
+
 // buffer pool hash table implementation
 
-int BufHashTbl::hash(const File* file, const int pageNo)
+// allocate an empty, cache-line aligned array of buckets (a power of two)
+hashSlots* BufHashTbl::allocTable(const int buckets)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+  void* mem;
+  size_t size = sizeof(hashSlots) + buckets * sizeof(hashBucket);
+  if (posix_memalign(&mem, 64, size) != 0) {
+    cerr << "BufHashTbl: cannot allocate " << buckets << " buckets" << endl;
+    exit(1);
+  }
+  memset(mem, 0, size);
+  hashSlots* s = (hashSlots*) mem;
+  s->mask = buckets - 1;
+  s->shift = 64;
+  for (int n = buckets; n > 1; n >>= 1)
+    s->shift--;
+  return s;
 }
 
 
 BufHashTbl::BufHashTbl(int htSize)
 {
-  HTSIZE = htSize;
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  // keep the load factor at or below 3/4 for htSize entries
+  int buckets = 8;
+  while (buckets < htSize + htSize / 3)
+    buckets *= 2;
+  slots = allocTable(buckets);
+  count = 0;
 }
 
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
-  delete [] ht;
+  Epoch::retire(slots);
+}
+
+
+// move the entries to a table of buckets buckets; only happens if a
+// partition gets far more than its share of the pages, or the pool grows.
+// Readers still in the old table keep using it until they leave their
+// epoch; readers of the new table may miss entries until it is filled,
+// and fall back to the latch.
+void BufHashTbl::grow(const unsigned int buckets)
+{
+  hashSlots* old = slots;
+  hashSlots* s = allocTable(buckets);
+  hashBucket* b = old->bucket();
+  slots = s;
+  count = 0;
+  for (unsigned int i = 0; i <= old->mask; i++)
+    if (b[i].key.load(memory_order_relaxed))
+      insert(b[i].key, b[i].frameNo);
+  Epoch::retire(old);
+}
+
+
+// the load factor the constructor sizes for, at htSize entries
+void BufHashTbl::reserve(const int htSize)
+{
+  unsigned int buckets = slots.load()->mask + 1;
+  while (buckets < (unsigned int) (htSize + htSize / 3))
+    buckets *= 2;
+  if (buckets > slots.load()->mask + 1)
+    grow(buckets);
 }
 
 
 //---------------------------------------------------------------
-// insert entry into hash table mapping (file,pageNo) to frameNo;
+// insert entry into hash table mapping page key to frameNo;
 // returns OK if OK, HASHTBLERROR if an error occurred
 //---------------------------------------------------------------
 
-Status BufHashTbl::insert(const File* file, const int pageNo, const int frameNo) {
-
-  int index = hash(file, pageNo);
+Status BufHashTbl::insert(const PageId key, const int frameNo) {
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-      return HASHTBLERROR;
-    tmpBuc = tmpBuc->next;
+  int dummy;
+  if (!key || lookup(key, dummy) == OK)
+    return HASHTBLERROR;
+  hashSlots* s = slots;
+  if ((unsigned int) (count + 1) > (s->mask + 1) / 8 * 7) {
+    grow((s->mask + 1) * 2);
+    s = slots;
   }
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-    return HASHTBLERROR;
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  // walk from the home bucket; an entry that is closer to its own home
+  // than we are to ours gives up its bucket and moves on instead
+  PageId eKey = key;
+  int eFrame = frameNo;
+  hashBucket* b = s->bucket();
+  unsigned int index = home(s, key);
+  unsigned int dist = 0;
+  while (b[index].key.load(memory_order_relaxed)) {
+    unsigned int other = probeDist(s, index);
+    if (other < dist) {
+      eKey = b[index].key.exchange(eKey, memory_order_relaxed);
+      eFrame = b[index].frameNo.exchange(eFrame, memory_order_relaxed);
+      dist = other;
+    }
+    index = (index + 1) & s->mask;
+    dist++;
+  }
+  b[index].frameNo.store(eFrame, memory_order_relaxed);
+  b[index].key.store(eKey, memory_order_relaxed);
+  count++;
 
   return OK;
 }
 
 
-//-------------------------------------------------------------------	     
-// Check if (file,pageNo) is currently in the buffer pool (ie. in
-// the hash table).  If so, return corresponding frameNo. else return 
-// HASHNOTFOUND
-//-------------------------------------------------------------------
-
-Status BufHashTbl::lookup(const File* file, const int pageNo, int& frameNo) 
-  {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+// search the bucket array s for key; entries are ordered by distance
+// from home, so the search can stop at the first entry closer to its
+// home than we are.  Bounded by the number of buckets.
+Status BufHashTbl::probe(hashSlots* s, const PageId key, int& frameNo)
+{
+  hashBucket* b = s->bucket();
+  unsigned int index = home(s, key);
+  for (unsigned int dist = 0; dist <= s->mask; dist++) {
+    PageId k = b[index].key.load(memory_order_relaxed);
+    if (!k)
+      break;
+    if (k == key)
     {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
+      frameNo = b[index].frameNo.load(memory_order_relaxed); // return frameNo by reference
       return OK;
     }
-    tmpBuc = tmpBuc->next;
+    if (probeDist(s, index) < dist)
+      break;
+    index = (index + 1) & s->mask;
   }
   return HASHNOTFOUND;
 }
 
 
+//-------------------------------------------------------------------	     
+// Check if page key is currently in the buffer pool (ie. in
+// the hash table).  If so, return corresponding frameNo. else return 
+// HASHNOTFOUND
 //-------------------------------------------------------------------
-// delete entry (file,pageNo) from hash table. REturn OK if page was
-// found.  Else return HASHTBLERROR
+
+Status BufHashTbl::lookup(const PageId key, int& frameNo) 
+{
+  return probe(slots, key, frameNo);
+}
+
+
 //-------------------------------------------------------------------
+// Same as lookup, but safe to call without the caller's latch.  Returns
+// HASHNOTFOUND if no epoch slot was available.
+//-------------------------------------------------------------------
+
+Status BufHashTbl::peek(const PageId key, int& frameNo) const
+{
+  if (!Epoch::enter())
+    return HASHNOTFOUND;
+  Status status = probe(slots, key, frameNo);
+  Epoch::exit();
+  return status;
+}
 
-Status BufHashTbl::remove(const File* file, const int pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = ht[index];
+//-------------------------------------------------------------------
+// delete entry for page key from hash table. REturn OK if page was
+// found.  Else return HASHTBLERROR
+//-------------------------------------------------------------------
+
+Status BufHashTbl::remove(const PageId key) {
 
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-      if (tmpBuc == ht[index]) 
-	ht[index] = tmpBuc->next;
-      else
-	prevBuc->next = tmpBuc->next;
-      delete tmpBuc;
+  hashSlots* s = slots;
+  hashBucket* b = s->bucket();
+  unsigned int index = home(s, key);
+  for (unsigned int dist = 0; b[index].key.load(memory_order_relaxed); dist++) {
+    if (b[index].key.load(memory_order_relaxed) == key) {
+      // shift the following entries of the run back by one bucket
+      unsigned int next = (index + 1) & s->mask;
+      while (b[next].key.load(memory_order_relaxed) && probeDist(s, next) > 0) {
+	b[index].frameNo.store(b[next].frameNo.load(memory_order_relaxed),
+			       memory_order_relaxed);
+	b[index].key.store(b[next].key.load(memory_order_relaxed),
+			   memory_order_relaxed);
+	index = next;
+	next = (next + 1) & s->mask;
+      }
+      b[index].key.store(0, memory_order_relaxed);
+      count--;
       return OK;
-    } else {
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
     }
+    if (probeDist(s, index) < dist)
+      break;
+    index = (index + 1) & s->mask;
   }
 
   return HASHTBLERROR;
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <math.h>
+#include <iomanip>
+#include "bufMetrics.h"
+
+
+BufMetrics::BufMetrics()
+{
+  for (int f = 0; f < METRICFILES; f++)
+    owner[f] = 0;
+  for (int s = 0; s < METRICSHARDS; s++)
+    for (int f = 0; f < METRICFILES; f++)
+      for (int c = 0; c < NCOUNTERS; c++)
+	shards[s].count[f][c] = 0;
+}
+
+const char* BufMetrics::name(const BufCounter c)
+{
+  switch (c) {
+  case HITS:        return "hits";
+  case MISSES:      return "misses";
+  case READS:       return "reads";
+  case WRITES:      return "writes";
+  case FLUSHWRITES: return "flushwrites";
+  case EVICTCLEAN:  return "evictclean";
+  case EVICTDIRTY:  return "evictdirty";
+  case PINWAITS:    return "pinwaits";
+  case SWEEP:       return "sweep";
+  default:          return "?";
+  }
+}
+
+int BufMetrics::shard()
+{
+  static atomic<int> threads(0);
+  static thread_local int mine = threads++ % METRICSHARDS;
+  return mine;
+}
+
+int BufMetrics::lend(const int s, const File* file)
+{
+  lock_guard<mutex> guard(latch);
+  if (owner[s] == 0) {
+    names[s] = file->getName();
+    owner[s] = file->getId();
+  }
+  return owner[s] == file->getId() ? s : 0;
+}
+
+void BufMetrics::closeFile(const File* file)
+{
+  int id = file->getId();
+  int s = slot(id);
+  lock_guard<mutex> guard(latch);
+  if (s == 0 || owner[s] != id)
+    return;
+  Row& row = closed.insert(make_pair(file->getName(),
+				     Row(file->getName()))).first->second;
+  for (int h = 0; h < METRICSHARDS; h++)
+    for (int c = 0; c < NCOUNTERS; c++)
+      row.count[c] += shards[h].count[s][c].exchange(0);
+  owner[s] = 0;
+  names[s].clear();
+}
+
+BufMetrics::Snapshot BufMetrics::snapshot() const
+{
+  lock_guard<mutex> guard(latch);
+  map<string, Row> rows = closed;
+  Row total("total");
+  for (int f = 0; f < METRICFILES; f++) {
+    Row live;
+    bool any = false;
+    for (int s = 0; s < METRICSHARDS; s++)
+      for (int c = 0; c < NCOUNTERS; c++) {
+	live.count[c] += shards[s].count[f][c].load(memory_order_relaxed);
+	any = any || live.count[c] != 0;
+      }
+    if (!any)
+      continue;
+    string name = f > 0 && owner[f] != 0 ? names[f] : "(other)";
+    Row& row = rows.insert(make_pair(name, Row(name))).first->second;
+    for (int c = 0; c < NCOUNTERS; c++)
+      row.count[c] += live.count[c];
+  }
+  Snapshot snap(1, total);
+  for (map<string, Row>::iterator it = rows.begin(); it != rows.end(); ++it) {
+    for (int c = 0; c < NCOUNTERS; c++)
+      snap[0].count[c] += it->second.count[c];
+    snap.push_back(it->second);
+  }
+  return snap;
+}
+
+void BufMetrics::clear()
+{
+  lock_guard<mutex> guard(latch);
+  for (int s = 0; s < METRICSHARDS; s++)
+    for (int f = 0; f < METRICFILES; f++)
+      for (int c = 0; c < NCOUNTERS; c++)
+	shards[s].count[f][c] = 0;
+  closed.clear();
+}
+
+// name as a JSON string
+static void jsonString(ostream& out, const string& s)
+{
+  out << '"';
+  for (size_t i = 0; i < s.size(); i++) {
+    unsigned char ch = s[i];
+    if (ch == '"' || ch == '\\')
+      out << '\\' << ch;
+    else if (ch < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof esc, "\\u%04x", ch);
+      out << esc;
+    } else
+      out << ch;
+  }
+  out << '"';
+}
+
+static void jsonRow(ostream& out, const BufMetrics::Row& row)
+{
+  out << '{';
+  for (int c = 0; c < NCOUNTERS; c++)
+    out << (c ? ", " : "") << '"' << BufMetrics::name((BufCounter) c)
+	<< "\": " << row.count[c];
+  out << '}';
+}
+
+void BufMetrics::dump(ostream& out, const bool json) const
+{
+  Snapshot snap = snapshot();
+  if (json) {
+    out << "{\"total\": ";
+    jsonRow(out, snap[0]);
+    out << ", \"files\": {";
+    for (size_t r = 1; r < snap.size(); r++) {
+      out << (r > 1 ? ", " : "");
+      jsonString(out, snap[r].name);
+      out << ": ";
+      jsonRow(out, snap[r]);
+    }
+    out << "}}" << endl;
+    return;
+  }
+  size_t width = 8;
+  for (size_t r = 0; r < snap.size(); r++)
+    width = max(width, snap[r].name.size() + 1);
+  out << left << setw(width) << "file" << right;
+  for (int c = 0; c < NCOUNTERS; c++)
+    out << ' ' << setw(11) << name((BufCounter) c);
+  out << endl;
+  for (size_t r = 0; r < snap.size(); r++) {
+    out << left << setw(width) << snap[r].name << right;
+    for (int c = 0; c < NCOUNTERS; c++)
+      out << ' ' << setw(11) << snap[r].count[c];
+    out << endl;
+  }
+}
+
+
+LatencyHistogram::LatencyHistogram() : count(0), sum(0)
+{
+  for (int b = 0; b < LATENCYBUCKETS; b++)
+    bucket[b] = 0;
+}
+
+uint64_t LatencyHistogram::highest(const int b)
+{
+  if (b < (1 << LATENCYBITS))
+    return b;
+  int log = (b >> LATENCYBITS) + LATENCYBITS - 1;
+  uint64_t low = (uint64_t) ((1 << LATENCYBITS) + (b & ((1 << LATENCYBITS) - 1)))
+    << (log - LATENCYBITS);
+  return low + ((uint64_t) 1 << (log - LATENCYBITS)) - 1;
+}
+
+uint64_t LatencyHistogram::percentile(const double p) const
+{
+  if (count == 0)
+    return 0;
+  // the rank of the sample wanted, 1 to count
+  uint64_t rank = (uint64_t) ceil(p / 100 * count);
+  rank = std::max(rank, (uint64_t) 1);
+  uint64_t seen = 0;
+  int last = 0;
+  for (int b = 0; b < LATENCYBUCKETS; b++) {
+    if (bucket[b] == 0)
+      continue;
+    seen += bucket[b];
+    last = b;
+    if (seen >= rank)
+      break;
+  }
+  return highest(last);
+}
+
+
+BufLatency::BufLatency() : shards(new Shard[METRICSHARDS]), enabled(false)
+{
+  clear();
+}
+
+BufLatency::~BufLatency()
+{
+  delete [] shards;
+}
+
+const char* BufLatency::name(const BufTimer t)
+{
+  switch (t) {
+  case READHIT:   return "readhit";
+  case READMISS:  return "readmiss";
+  case ALLOCPAGE: return "allocpage";
+  case VICTIM:    return "victim";
+  case FILEREAD:  return "fileread";
+  case FILEWRITE: return "filewrite";
+  default:        return "?";
+  }
+}
+
+LatencyHistogram BufLatency::histogram(const BufTimer t) const
+{
+  LatencyHistogram h;
+  for (int s = 0; s < METRICSHARDS; s++) {
+    for (int b = 0; b < LATENCYBUCKETS; b++) {
+      uint64_t n = shards[s].bucket[t][b].load(memory_order_relaxed);
+      h.bucket[b] += n;
+      h.count += n;
+    }
+    h.sum += shards[s].sum[t].load(memory_order_relaxed);
+  }
+  return h;
+}
+
+void BufLatency::clear()
+{
+  for (int s = 0; s < METRICSHARDS; s++)
+    for (int t = 0; t < NTIMERS; t++) {
+      for (int b = 0; b < LATENCYBUCKETS; b++)
+	shards[s].bucket[t][b].store(0, memory_order_relaxed);
+      shards[s].sum[t].store(0, memory_order_relaxed);
+    }
+}
+
+void BufLatency::dump(ostream& out, const bool json) const
+{
+  static const double percents[] = {50, 90, 99, 99.9};
+  static const char* labels[] = {"p50", "p90", "p99", "p99.9"};
+  const int npercents = sizeof percents / sizeof percents[0];
+  ios::fmtflags flags = out.flags();
+  streamsize precision = out.precision();
+  out << fixed << setprecision(1);
+  if (json)
+    out << '{';
+  else {
+    out << left << setw(10) << "timer" << right << ' ' << setw(10) << "count"
+	<< ' ' << setw(9) << "mean us";
+    for (int k = 0; k < npercents; k++)
+      out << ' ' << setw(9) << labels[k];
+    out << ' ' << setw(9) << "max" << endl;
+  }
+  for (int t = 0; t < NTIMERS; t++) {
+    LatencyHistogram h = histogram((BufTimer) t);
+    if (json) {
+      out << (t ? ", " : "") << '"' << name((BufTimer) t) << "\": {\"count\": "
+	  << h.count << ", \"mean\": " << h.mean() / 1000;
+      for (int k = 0; k < npercents; k++)
+	out << ", \"" << labels[k] << "\": " << h.percentile(percents[k]) / 1000.0;
+      out << ", \"max\": " << h.max() / 1000.0 << '}';
+      continue;
+    }
+    out << left << setw(10) << name((BufTimer) t) << right << ' ' << setw(10)
+	<< h.count << ' ' << setw(9) << h.mean() / 1000;
+    for (int k = 0; k < npercents; k++)
+      out << ' ' << setw(9) << h.percentile(percents[k]) / 1000.0;
+    out << ' ' << setw(9) << h.max() / 1000.0 << endl;
+  }
+  if (json)
+    out << '}' << endl;
+  out.flags(flags);
+  out.precision(precision);
+}
@@ -0,0 +1,219 @@
+#ifndef BUFMETRICS_H
+#define BUFMETRICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "page.h"
+#include "db.h"
+
+// what BufMetrics counts, per file
+enum BufCounter {
+  HITS,         // readPage() found the page in the pool
+  MISSES,       // readPage() had to read the page
+  READS,        // pages read from the file, prefetch() included
+  WRITES,       // pages written back to the file
+  FLUSHWRITES,  // of those, written by flushFile()
+  EVICTCLEAN,   // pages replaced that were clean
+  EVICTDIRTY,   // pages replaced that had to be written back first
+  PINWAITS,     // times a thread waited for another one to finish with a frame
+  SWEEP,        // frames the replacement policy looked at for victims; pool wide
+  NCOUNTERS
+};
+
+// slots of counters: slot 0 is shared, the others are each lent to a file
+const int METRICFILES = 64;
+
+// threads pick one of these shards of counters round robin
+const int METRICSHARDS = 16;
+
+// Counters of a buffer pool, broken down by file.  count() is cheap
+// enough for every page access: each thread adds to its own shard of
+// 64 bit counters, so threads do not fight over cache lines, and only
+// snapshot() adds the shards up.
+//
+// Files are told apart by their ids (File::getId).  File id i counts in
+// slot 1 + (i - 1) % (METRICFILES - 1) if no other open file has it;
+// closeFile() moves a file's counts to a total kept under its name and
+// frees the slot.  Counts of files without a slot, and the pool wide
+// SWEEP count, go to the row named "(other)".
+class BufMetrics
+{
+public:
+  // counts of one file, or of all of them
+  struct Row
+  {
+    string   name;
+    uint64_t count[NCOUNTERS];
+
+    Row(const string& name = "") : name(name)
+    {
+      for (int c = 0; c < NCOUNTERS; c++)
+	count[c] = 0;
+    }
+  };
+  // the pool total first, then the files by name
+  typedef vector<Row> Snapshot;
+
+  BufMetrics();
+
+  void count(const File* file, const BufCounter c, const uint64_t n = 1)
+  {
+    int id = file->getId();
+    int s = slot(id);
+    int holder = owner[s].load(memory_order_relaxed);
+    if (holder != id)
+      s = holder == 0 && s != 0 ? lend(s, file) : 0;
+    add(s, c, n);
+  }
+  // count for a file only known by its id; the file has been counted
+  // through count() before
+  void countId(const int fileId, const BufCounter c, const uint64_t n = 1)
+  {
+    int s = slot(fileId);
+    add(owner[s].load(memory_order_relaxed) == fileId ? s : 0, c, n);
+  }
+
+  // the file is being closed; keep its counts under its name
+  void closeFile(const File* file);
+
+  Snapshot snapshot() const;
+  void clear();
+
+  // the counters as a table, one file per line, or as a JSON object
+  // {"total": {counter: n, ...}, "files": {name: {counter: n, ...}, ...}}
+  void dump(ostream& out, const bool json = false) const;
+  static const char* name(const BufCounter c);
+  // the calling thread's shard of counters
+  static int shard();
+
+private:
+  struct alignas(64) Shard
+  {
+    atomic<uint64_t> count[METRICFILES][NCOUNTERS];
+  };
+
+  Shard shards[METRICSHARDS];
+  atomic<int> owner[METRICFILES];   // id of the file a slot is lent to, or 0
+  mutable mutex latch;              // protects names and closed
+  string names[METRICFILES];
+  map<string, Row> closed;          // counts of files closed so far
+
+  void add(const int slot, const BufCounter c, const uint64_t n)
+  {
+    shards[shard()].count[slot][c].fetch_add(n, memory_order_relaxed);
+  }
+  static int slot(const int fileId)
+  {
+    return fileId > 0 ? 1 + (fileId - 1) % (METRICFILES - 1) : 0;
+  }
+  // lend slot s to the file, if still free; the slot to count in
+  int lend(const int s, const File* file);
+};
+
+
+// what BufLatency times
+enum BufTimer {
+  READHIT,      // readPage() of a page in the pool
+  READMISS,     // readPage() that had to read the page
+  ALLOCPAGE,    // allocPage() and allocPages()
+  VICTIM,       // allocBuf() finding a frame to replace, write-back not included
+  FILEREAD,     // the buffer manager's reads from files, a request each
+  FILEWRITE,    // the buffer manager's writes to files, a request each
+  NTIMERS
+};
+
+// latencies below 1 << LATENCYBITS ns have a bucket each, above that every
+// power of two is split in that many buckets, up to 1 << LATENCYMAXLOG ns
+const int LATENCYBITS = 4;
+const int LATENCYMAXLOG = 39;
+const int LATENCYBUCKETS = (LATENCYMAXLOG - LATENCYBITS + 2) << LATENCYBITS;
+
+// a histogram of latencies in nanoseconds, as HdrHistogram keeps them:
+// the buckets grow with the values, so every value is known to within
+// 1 / (1 << LATENCYBITS) of itself
+struct LatencyHistogram
+{
+  uint64_t bucket[LATENCYBUCKETS];
+  uint64_t count;
+  uint64_t sum;
+
+  LatencyHistogram();
+  // the bucket of a latency, and the largest latency in a bucket
+  static int bucketOf(const uint64_t ns)
+  {
+    if (ns < (1 << LATENCYBITS))
+      return ns;
+    int log = 63 - __builtin_clzll(ns);
+    if (log > LATENCYMAXLOG)
+      return LATENCYBUCKETS - 1;
+    return ((log - LATENCYBITS + 1) << LATENCYBITS)
+      + ((ns >> (log - LATENCYBITS)) & ((1 << LATENCYBITS) - 1));
+  }
+  static uint64_t highest(const int b);
+
+  double mean() const { return count ? (double) sum / count : 0; }
+  // the latency p percent of the samples are at or below
+  uint64_t percentile(const double p) const;
+  uint64_t max() const { return percentile(100); }
+};
+
+// Latency histograms of a buffer pool.  Timing is off to begin with and
+// costs a load when off; when on, two reads of the clock and an add to
+// the thread's shard of buckets, as for BufMetrics.  Timed code does
+//
+//   uint64_t start = latency.start();
+//   ...
+//   latency.record(VICTIM, start);
+//
+// and a sample started before timing was switched on is dropped.
+class BufLatency
+{
+public:
+  BufLatency();
+  ~BufLatency();
+
+  void enable(const bool on) { enabled.store(on, memory_order_relaxed); }
+  bool isEnabled() const { return enabled.load(memory_order_relaxed); }
+
+  uint64_t start() const { return isEnabled() ? now() : 0; }
+  void record(const BufTimer t, const uint64_t start)
+  {
+    if (start == 0)
+      return;
+    uint64_t ns = now() - start;
+    Shard& sh = shards[BufMetrics::shard()];
+    sh.bucket[t][LatencyHistogram::bucketOf(ns)].fetch_add(1, memory_order_relaxed);
+    sh.sum[t].fetch_add(ns, memory_order_relaxed);
+  }
+
+  LatencyHistogram histogram(const BufTimer t) const;
+  void clear();
+  // count, mean, percentiles and maximum of every timer in microseconds,
+  // as a table or as a JSON object {timer: {"count": n, ...}, ...}
+  void dump(ostream& out, const bool json = false) const;
+  static const char* name(const BufTimer t);
+
+private:
+  struct alignas(64) Shard
+  {
+    atomic<uint64_t> bucket[NTIMERS][LATENCYBUCKETS];
+    atomic<uint64_t> sum[NTIMERS];
+  };
+
+  Shard* shards;  // METRICSHARDS of them
+  atomic<bool> enabled;
+
+  static uint64_t now()
+  {
+    return chrono::duration_cast<chrono::nanoseconds>
+      (chrono::steady_clock::now().time_since_epoch()).count();
+  }
+};
+
+#endif
@@ -0,0 +1,910 @@
+#include <algorithm>
+#include "bufPolicy.h"
+
+
+BufPolicy* BufPolicy::create(const ReplPolicy kind, BufDesc* table,
+			     const int bufs, BufMetrics* metrics,
+			     const int capacity)
+{
+  int cap = max(bufs, capacity);
+  BufPolicy* policy;
+  switch (kind) {
+  case LRUK:     policy = new LRUKPolicy(table, bufs, cap); break;
+  case TWOQ:     policy = new TwoQPolicy(table, bufs, cap); break;
+  case ARC:      policy = new ARCPolicy(table, bufs, cap); break;
+  case CLOCKPRO: policy = new ClockProPolicy(table, bufs, cap); break;
+  default:       policy = new ClockPolicy(table, bufs, cap); break;
+  }
+  policy->metrics = metrics;
+  return policy;
+}
+
+const char* BufPolicy::name(const ReplPolicy kind)
+{
+  switch (kind) {
+  case LRUK:     return "lruk";
+  case TWOQ:     return "2q";
+  case ARC:      return "arc";
+  case CLOCKPRO: return "clockpro";
+  default:       return "clock";
+  }
+}
+
+// A frame moved to the front of l itself is looked at again when the
+// walk gets there.  Flags are only heeded for as many frames as l had, so
+// that hits coming in meanwhile cannot keep the walk going.
+int BufPolicy::lastUnpinned(FrameLists& lists, const int l, atomic<bool>* hit,
+			    const int to) const
+{
+  int frame = lists.back(l);
+  int n = 0;
+  int heeded = hit ? lists.size(l) : 0;
+  while (frame != -1) {
+    int before = lists.before(frame);
+    if (n < heeded && hit[frame].exchange(false)) {
+      lists.pushFront(to, frame);
+      //the front frame stays where it is
+      if (before == -1 && to == l)
+	before = frame;
+    } else if (!pinned(frame))
+      break;
+    frame = before;
+    n++;
+  }
+  swept(frame != -1 ? n + 1 : n);
+  return frame;
+}
+
+void BufPolicy::fromBack(const FrameLists& lists, const int l,
+			 vector<int>& frames, const int n,
+			 const atomic<bool>* hit) const
+{
+  for (int frame = lists.back(l); frame != -1 && (int) frames.size() < n;
+       frame = lists.before(frame))
+    if (!hit || !hit[frame])
+      frames.push_back(frame);
+}
+
+
+FrameLists::FrameLists(const int frames, const int lists) : frames(frames)
+{
+  prev = new int[frames + lists];
+  next = new int[frames + lists];
+  owner = new int[frames];
+  count = new int[lists];
+  for (int i = 0; i < frames; i++)
+    owner[i] = -1;
+  for (int l = 0; l < lists; l++) {
+    prev[frames + l] = next[frames + l] = frames + l;
+    count[l] = 0;
+  }
+}
+
+FrameLists::~FrameLists()
+{
+  delete [] prev;
+  delete [] next;
+  delete [] owner;
+  delete [] count;
+}
+
+void FrameLists::pushFront(const int l, const int frame)
+{
+  remove(frame);
+  int head = frames + l;
+  prev[frame] = head;
+  next[frame] = next[head];
+  prev[next[head]] = frame;
+  next[head] = frame;
+  owner[frame] = l;
+  count[l]++;
+}
+
+void FrameLists::remove(const int frame)
+{
+  if (owner[frame] == -1)
+    return;
+  next[prev[frame]] = next[frame];
+  prev[next[frame]] = prev[frame];
+  count[owner[frame]]--;
+  owner[frame] = -1;
+}
+
+
+void GhostList::push(const PageId id)
+{
+  remove(id);
+  order.push_back(id);
+  where[id] = --order.end();
+}
+
+void GhostList::remove(const PageId id)
+{
+  auto it = where.find(id);
+  if (it == where.end())
+    return;
+  order.erase(it->second);
+  where.erase(it);
+}
+
+PageId GhostList::popOldest()
+{
+  PageId id = order.front();
+  where.erase(id);
+  order.pop_front();
+  return id;
+}
+
+
+//----------------------------------------
+// CLOCK
+//----------------------------------------
+
+ClockPolicy::ClockPolicy(BufDesc* table, const int bufs, const int capacity)
+  : BufPolicy(table, bufs, capacity)
+{
+  refbit = new atomic<bool>[capacity];
+  for (int i = 0; i < capacity; i++)
+    refbit[i] = false;
+  //start at bufs - 1, so that the first frame we look at is frame 0
+  clockHand = bufs - 1;
+}
+
+ClockPolicy::~ClockPolicy()
+{
+  delete [] refbit;
+}
+
+void ClockPolicy::accessed(const int frame)
+{
+  refbit[frame] = true;
+}
+
+void ClockPolicy::loaded(const int frame, const PageId id)
+{
+  refbit[frame] = true;
+}
+
+void ClockPolicy::evicted(const int frame)
+{
+  refbit[frame] = false;
+}
+
+void ClockPolicy::dropped(const int frame)
+{
+  refbit[frame] = false;
+}
+
+int ClockPolicy::victim(const PageId incoming)
+{
+  // a frame pinned bufs times in a row means all of them are pinned.  A
+  // resize() meanwhile only makes the hand pass frames that are claimed.
+  int bufs = numBufs;
+  int numPin = 0;
+  int count = 0;
+  while (1) {
+    int hand = (clockHand.fetch_add(1) + 1) % bufs;
+    count++;
+    if (count % bufs == 0)
+      numPin = 0;
+    //recently referenced, clear the ref bit and advance the clock
+    if (refbit[hand]) {
+      refbit[hand] = false;
+      continue;
+    }
+    if (pinned(hand)) {
+      if (++numPin == bufs) {
+	swept(count);
+	return -1;
+      }
+      continue;
+    }
+    swept(count);
+    return hand;
+  }
+}
+
+// the frames ahead of the hand whose reference bit is clear, then,
+// since a sweep clears the bits, the others in the order of the hand
+void ClockPolicy::nextVictims(vector<int>& frames, const int n)
+{
+  frames.clear();
+  unsigned int hand = clockHand;
+  int bufs = numBufs;
+  for (int pass = 0; pass < 2; pass++)
+    for (int i = 1; i <= bufs && (int) frames.size() < n; i++) {
+      int frame = (hand + i) % bufs;
+      if (refbit[frame] == (pass == 1))
+	frames.push_back(frame);
+    }
+}
+
+// frames given up have their bits clear (dropped), and so do new ones
+void ClockPolicy::resize(const int bufs)
+{
+  numBufs = bufs;
+}
+
+
+//----------------------------------------
+// LRU-K
+//----------------------------------------
+
+LRUKPolicy::LRUKPolicy(BufDesc* table, const int bufs, const int capacity,
+		       const int k)
+  : BufPolicy(table, bufs, capacity), k(k), now(0)
+{
+  history = new unsigned long[capacity * k];
+  pages = new PageId[capacity];
+  hit = new atomic<bool>[capacity];
+  for (int i = 0; i < capacity * k; i++)
+    history[i] = 0;
+  for (int i = 0; i < capacity; i++) {
+    pages[i] = 0;
+    hit[i] = false;
+  }
+  for (int i = 0; i < bufs; i++)
+    order.insert(make_pair(rank(i), i));
+}
+
+LRUKPolicy::~LRUKPolicy()
+{
+  delete [] history;
+  delete [] pages;
+  delete [] hit;
+}
+
+// frames without a page rank (0, 0) and come first
+LRUKPolicy::Rank LRUKPolicy::rank(const int frame) const
+{
+  return Rank(history[frame * k + k - 1], history[frame * k]);
+}
+
+void LRUKPolicy::reference(const int frame)
+{
+  unsigned long* h = &history[frame * k];
+  for (int i = k - 1; i > 0; i--)
+    h[i] = h[i - 1];
+  h[0] = ++now;
+}
+
+void LRUKPolicy::accessed(const int frame)
+{
+  hit[frame] = true;
+}
+
+void LRUKPolicy::loaded(const int frame, const PageId id)
+{
+  lock_guard<mutex> guard(latch);
+  hit[frame] = false;
+  order.erase(make_pair(rank(frame), frame));
+  pages[frame] = id;
+  auto it = retained.find(id);
+  if (it != retained.end()) {
+    copy(it->second.begin(), it->second.end(), &history[frame * k]);
+    retained.erase(it);
+    retainedOrder.remove(id);
+  }
+  reference(frame);
+  order.insert(make_pair(rank(frame), frame));
+}
+
+void LRUKPolicy::evicted(const int frame)
+{
+  lock_guard<mutex> guard(latch);
+  hit[frame] = false;
+  order.erase(make_pair(rank(frame), frame));
+  unsigned long* h = &history[frame * k];
+  retained[pages[frame]] = vector<unsigned long>(h, h + k);
+  retainedOrder.push(pages[frame]);
+  if (retainedOrder.size() > numBufs)
+    retained.erase(retainedOrder.popOldest());
+  fill(h, h + k, 0);
+  order.insert(make_pair(rank(frame), frame));
+}
+
+void LRUKPolicy::dropped(const int frame)
+{
+  lock_guard<mutex> guard(latch);
+  hit[frame] = false;
+  order.erase(make_pair(rank(frame), frame));
+  fill(&history[frame * k], &history[frame * k + k], 0);
+  order.insert(make_pair(rank(frame), frame));
+}
+
+// A frame hit since is referenced now; that ranks it higher, so it is
+// come to again further on, or right away if nothing ranks between.
+// Hits are only heeded for as many frames as there are, see
+// lastUnpinned().
+int LRUKPolicy::victim(const PageId incoming)
+{
+  lock_guard<mutex> guard(latch);
+  int n = 0;
+  int heeded = order.size();
+  for (auto it = order.begin(); it != order.end(); ) {
+    int frame = it->second;
+    n++;
+    if (n <= heeded && hit[frame].exchange(false)) {
+      auto next = it;
+      ++next;
+      order.erase(it);
+      reference(frame);
+      auto moved = order.insert(make_pair(rank(frame), frame)).first;
+      it = next == order.end() || *moved < *next ? moved : next;
+      continue;
+    }
+    if (!pinned(frame)) {
+      swept(n);
+      return frame;
+    }
+    ++it;
+  }
+  swept(n);
+  return -1;
+}
+
+void LRUKPolicy::nextVictims(vector<int>& frames, const int n)
+{
+  lock_guard<mutex> guard(latch);
+  frames.clear();
+  for (auto it = order.begin(); it != order.end() && (int) frames.size() < n; ++it)
+    if (!hit[it->second])
+      frames.push_back(it->second);
+}
+
+// the frames in question hold no page, so they rank (0, 0); the history
+// retained shrinks with the pool
+void LRUKPolicy::resize(const int bufs)
+{
+  lock_guard<mutex> guard(latch);
+  for (int i = bufs; i < numBufs; i++) {
+    hit[i] = false;
+    order.erase(make_pair(rank(i), i));
+  }
+  for (int i = numBufs; i < bufs; i++)
+    order.insert(make_pair(rank(i), i));
+  numBufs = bufs;
+  while (retainedOrder.size() > bufs)
+    retained.erase(retainedOrder.popOldest());
+}
+
+
+//----------------------------------------
+// 2Q
+//----------------------------------------
+
+// the sizes the 2Q paper recommends: A1in a quarter of the pool, A1out
+// remembers as many pages as half the pool holds
+TwoQPolicy::TwoQPolicy(BufDesc* table, const int bufs, const int capacity)
+  : BufPolicy(table, bufs, capacity), lists(capacity, 3)
+{
+  kin = max(1, bufs / 4);
+  kout = max(1, bufs / 2);
+  pages = new PageId[capacity];
+  hit = new atomic<bool>[capacity];
+  for (int i = 0; i < capacity; i++) {
+    pages[i] = 0;
+    hit[i] = false;
+  }
+  for (int i = 0; i < bufs; i++)
+    lists.pushFront(FREE, i);
+}
+
+TwoQPolicy::~TwoQPolicy()
+{
+  delete [] pages;
+  delete [] hit;
+}
+
+// hits in A1in are correlated references and do not count: only the
+// flags of frames in Am are looked at
+void TwoQPolicy::accessed(const int frame)
+{
+  hit[frame] = true;
+}
+
+void TwoQPolicy::loaded(const int frame, const PageId id)
+{
+  lock_guard<mutex> guard(latch);
+  hit[frame] = false;
+  pages[frame] = id;
+  if (a1out.contains(id)) {
+    a1out.remove(id);
+    lists.pushFront(AM, frame);
+  } else {
+    lists.pushFront(A1IN, frame);
+  }
+}
+
+void TwoQPolicy::evicted(const int frame)
+{
+  lock_guard<mutex> guard(latch);
+  hit[frame] = false;
+  if (lists.list(frame) == A1IN) {
+    a1out.push(pages[frame]);
+    if (a1out.size() > kout)
+      a1out.popOldest();
+  }
+  lists.pushFront(FREE, frame);
+}
+
+void TwoQPolicy::dropped(const int frame)
+{
+  lock_guard<mutex> guard(latch);
+  hit[frame] = false;
+  lists.pushFront(FREE, frame);
+}
+
+int TwoQPolicy::victim(const PageId incoming)
+{
+  lock_guard<mutex> guard(latch);
+  int frame = lastUnpinned(lists, FREE);
+  if (frame == -1 && lists.size(A1IN) > kin)
+    frame = lastUnpinned(lists, A1IN);
+  if (frame == -1)
+    frame = lastUnpinned(lists, AM, hit, AM);
+  if (frame == -1)
+    frame = lastUnpinned(lists, A1IN);
+  return frame;
+}
+
+void TwoQPolicy::nextVictims(vector<int>& frames, const int n)
+{
+  lock_guard<mutex> guard(latch);
+  frames.clear();
+  if (lists.size(A1IN) > kin)
+    fromBack(lists, A1IN, frames, min(n, lists.size(A1IN) - kin));
+  fromBack(lists, AM, frames, n, hit);
+  fromBack(lists, A1IN, frames, n);
+}
+
+// the frames in question are free; A1in and A1out are resized as the
+// constructor sizes them
+void TwoQPolicy::resize(const int bufs)
+{
+  lock_guard<mutex> guard(latch);
+  for (int i = bufs; i < numBufs; i++) {
+    hit[i] = false;
+    lists.remove(i);
+  }
+  for (int i = numBufs; i < bufs; i++)
+    lists.pushFront(FREE, i);
+  numBufs = bufs;
+  kin = max(1, bufs / 4);
+  kout = max(1, bufs / 2);
+  while (a1out.size() > kout)
+    a1out.popOldest();
+}
+
+
+//----------------------------------------
+// ARC
+//----------------------------------------
+
+ARCPolicy::ARCPolicy(BufDesc* table, const int bufs, const int capacity)
+  : BufPolicy(table, bufs, capacity), p(0), lists(capacity, 3)
+{
+  pages = new PageId[capacity];
+  hit = new atomic<bool>[capacity];
+  for (int i = 0; i < capacity; i++) {
+    pages[i] = 0;
+    hit[i] = false;
+  }
+  for (int i = 0; i < bufs; i++)
+    lists.pushFront(FREE, i);
+}
+
+ARCPolicy::~ARCPolicy()
+{
+  delete [] pages;
+  delete [] hit;
+}
+
+// T1 and B1 together remember at most as many pages as the pool holds,
+// all four lists at most twice that
+void ARCPolicy::trimGhosts()
+{
+  while (b1.size() > 0 && lists.size(T1) + b1.size() > numBufs)
+    b1.popOldest();
+  while (b2.size() > 0 &&
+	 lists.size(T1) + lists.size(T2) + b1.size() + b2.size() > 2 * numBufs)
+    b2.popOldest();
+}
+
+// a hit moves the page to the front of T2 when victim() comes to it; T1
+// counts the pages hit there until then
+void ARCPolicy::accessed(const int frame)
+{
+  hit[frame] = true;
+}
+
+void ARCPolicy::loaded(const int frame, const PageId id)
+{
+  lock_guard<mutex> guard(latch);
+  hit[frame] = false;
+  pages[frame] = id;
+  if (b1.contains(id)) {
+    //T1 was too small for this page: favor recency
+    p = min((int) numBufs, p + max(b2.size() / b1.size(), 1));
+    b1.remove(id);
+    lists.pushFront(T2, frame);
+  } else if (b2.contains(id)) {
+    //T2 was too small for this page: favor frequency
+    p = max(0, p - max(b1.size() / b2.size(), 1));
+    b2.remove(id);
+    lists.pushFront(T2, frame);
+  } else {
+    lists.pushFront(T1, frame);
+  }
+  trimGhosts();
+}
+
+void ARCPolicy::evicted(const int frame)
+{
+  lock_guard<mutex> guard(latch);
+  hit[frame] = false;
+  if (lists.list(frame) == T1)
+    b1.push(pages[frame]);
+  else if (lists.list(frame) == T2)
+    b2.push(pages[frame]);
+  lists.pushFront(FREE, frame);
+  trimGhosts();
+}
+
+void ARCPolicy::dropped(const int frame)
+{
+  lock_guard<mutex> guard(latch);
+  hit[frame] = false;
+  lists.pushFront(FREE, frame);
+}
+
+int ARCPolicy::victim(const PageId incoming)
+{
+  lock_guard<mutex> guard(latch);
+  int frame = lastUnpinned(lists, FREE);
+  if (frame != -1)
+    return frame;
+  //ARC's REPLACE: take from T1 while it is over its target size
+  int t1 = lists.size(T1);
+  bool fromT1 = t1 > 0 && (t1 > p || (t1 == p && b2.contains(incoming)));
+  frame = lastUnpinned(lists, fromT1 ? T1 : T2, hit, T2);
+  if (frame == -1)
+    frame = lastUnpinned(lists, fromT1 ? T2 : T1, hit, T2);
+  //pages hit in T1 have come to T2 after it was looked at
+  if (frame == -1 && !fromT1)
+    frame = lastUnpinned(lists, T2);
+  return frame;
+}
+
+void ARCPolicy::nextVictims(vector<int>& frames, const int n)
+{
+  lock_guard<mutex> guard(latch);
+  frames.clear();
+  if (lists.size(T1) > p)
+    fromBack(lists, T1, frames, min(n, lists.size(T1) - p), hit);
+  fromBack(lists, T2, frames, n, hit);
+  fromBack(lists, T1, frames, n, hit);
+}
+
+// the frames in question are free; the target size of T1 and the ghost
+// lists are cut down to a smaller pool
+void ARCPolicy::resize(const int bufs)
+{
+  lock_guard<mutex> guard(latch);
+  for (int i = bufs; i < numBufs; i++) {
+    hit[i] = false;
+    lists.remove(i);
+  }
+  for (int i = numBufs; i < bufs; i++)
+    lists.pushFront(FREE, i);
+  numBufs = bufs;
+  p = min(p, bufs);
+  trimGhosts();
+}
+
+
+//----------------------------------------
+// CLOCK-Pro
+//----------------------------------------
+
+ClockProPolicy::ClockProPolicy(BufDesc* table, const int bufs,
+			       const int capacity)
+  : BufPolicy(table, bufs, capacity), numHot(0), numCold(0),
+    numNonResident(0), unused(capacity, 1), handHot(-1), handCold(-1),
+    handTest(-1)
+{
+  //start with few cold frames and let the test periods adjust that
+  coldTarget = max(1, bufs / 10);
+  prev = new int[2 * capacity];
+  next = new int[2 * capacity];
+  linked = new bool[2 * capacity];
+  hot = new bool[2 * capacity];
+  test = new bool[2 * capacity];
+  pages = new PageId[2 * capacity];
+  refbit = new atomic<bool>[capacity];
+  spare = new int[capacity];
+  numSpare = 0;
+  for (int e = 0; e < 2 * capacity; e++) {
+    linked[e] = hot[e] = test[e] = false;
+    pages[e] = 0;
+  }
+  for (int i = 0; i < capacity; i++) {
+    refbit[i] = false;
+    spare[numSpare++] = capacity + i;
+  }
+  for (int i = 0; i < bufs; i++)
+    unused.pushFront(0, i);
+}
+
+ClockProPolicy::~ClockProPolicy()
+{
+  delete [] prev;
+  delete [] next;
+  delete [] linked;
+  delete [] hot;
+  delete [] test;
+  delete [] pages;
+  delete [] refbit;
+  delete [] spare;
+}
+
+void ClockProPolicy::link(const int e)
+{
+  if (handHot == -1) {
+    prev[e] = next[e] = e;
+    handHot = handCold = handTest = e;
+  } else {
+    next[e] = handHot;
+    prev[e] = prev[handHot];
+    next[prev[e]] = e;
+    prev[handHot] = e;
+  }
+  linked[e] = true;
+}
+
+void ClockProPolicy::unlink(const int e)
+{
+  if (next[e] == e) {
+    handHot = handCold = handTest = -1;
+  } else {
+    if (handHot == e)
+      handHot = next[e];
+    if (handCold == e)
+      handCold = next[e];
+    if (handTest == e)
+      handTest = next[e];
+    next[prev[e]] = next[e];
+    prev[next[e]] = prev[e];
+  }
+  linked[e] = false;
+}
+
+// a non-resident page whose test period ends is forgotten, and since it
+// was not needed again in time the cold share shrinks
+void ClockProPolicy::endTest(const int e)
+{
+  test[e] = false;
+  if (e >= capacity) {
+    nonResident.erase(pages[e]);
+    unlink(e);
+    spare[numSpare++] = e;
+    numNonResident--;
+    coldTarget = max(1, coldTarget - 1);
+  }
+}
+
+// turn one unreferenced hot page cold, ending the test periods passed on
+// the way
+void ClockProPolicy::runHandHot()
+{
+  int steps = 2 * (numHot + numCold + numNonResident);
+  while (handHot != -1 && steps-- > 0) {
+    int e = handHot;
+    int after = next[e];
+    if (e < capacity && hot[e]) {
+      handHot = after;
+      if (refbit[e]) {
+	refbit[e] = false;
+	continue;
+      }
+      hot[e] = false;
+      numHot--;
+      numCold++;
+      return;
+    }
+    if (test[e])
+      endTest(e);
+    if (handHot != -1)
+      handHot = after;
+  }
+}
+
+// end test periods until at most limit non-resident pages are left
+void ClockProPolicy::runHandTest(const int limit)
+{
+  int steps = 2 * (numHot + numCold + numNonResident);
+  while (numNonResident > limit && handTest != -1 && steps-- > 0) {
+    int e = handTest;
+    int after = next[e];
+    if (!hot[e] && test[e])
+      endTest(e);
+    if (handTest != -1)
+      handTest = after;
+  }
+}
+
+void ClockProPolicy::accessed(const int frame)
+{
+  refbit[frame] = true;
+}
+
+void ClockProPolicy::loaded(const int frame, const PageId id)
+{
+  lock_guard<mutex> guard(latch);
+  unused.remove(frame);
+  pages[frame] = id;
+  refbit[frame] = false;
+  auto it = nonResident.find(id);
+  if (it != nonResident.end()) {
+    //reused within its test period: the page is hot, and cold pages
+    //deserve more room
+    int e = it->second;
+    nonResident.erase(it);
+    unlink(e);
+    test[e] = false;
+    spare[numSpare++] = e;
+    numNonResident--;
+    coldTarget = min(max(1, numBufs - 1), coldTarget + 1);
+    hot[frame] = true;
+    test[frame] = false;
+    link(frame);
+    numHot++;
+    for (int i = 0; numHot > numBufs - coldTarget && i < numBufs; i++)
+      runHandHot();
+  } else {
+    hot[frame] = false;
+    test[frame] = true;
+    link(frame);
+    numCold++;
+  }
+}
+
+void ClockProPolicy::evicted(const int frame)
+{
+  lock_guard<mutex> guard(latch);
+  if (linked[frame]) {
+    if (!hot[frame] && test[frame]) {
+      //keep the page on the clock, non-resident, until its test ends
+      if (numNonResident >= numBufs)
+	runHandTest(numBufs - 1);
+      if (numNonResident < numBufs) {
+	int e = spare[--numSpare];
+	pages[e] = pages[frame];
+	hot[e] = false;
+	test[e] = true;
+	prev[e] = frame;
+	next[e] = next[frame];
+	prev[next[frame]] = e;
+	next[frame] = e;
+	linked[e] = true;
+	nonResident[pages[e]] = e;
+	numNonResident++;
+      }
+    }
+    unlink(frame);
+    if (hot[frame])
+      numHot--;
+    else
+      numCold--;
+  }
+  hot[frame] = test[frame] = false;
+  refbit[frame] = false;
+  unused.pushFront(0, frame);
+}
+
+void ClockProPolicy::dropped(const int frame)
+{
+  lock_guard<mutex> guard(latch);
+  if (linked[frame]) {
+    unlink(frame);
+    if (hot[frame])
+      numHot--;
+    else
+      numCold--;
+  }
+  hot[frame] = test[frame] = false;
+  refbit[frame] = false;
+  unused.pushFront(0, frame);
+}
+
+int ClockProPolicy::victim(const PageId incoming)
+{
+  lock_guard<mutex> guard(latch);
+  int frame = lastUnpinned(unused, 0);
+  if (frame != -1)
+    return frame;
+  //hand cold only stops at cold pages.  Give up right away if every
+  //frame is pinned.
+  bool any = false;
+  for (int i = 0; i < numBufs && !any; i++)
+    any = !pinned(i);
+  if (!any)
+    return -1;
+  int looked = 0;
+  int steps = 2 * (numHot + numCold + numNonResident);
+  while (handCold != -1 && steps-- > 0) {
+    int e = handCold;
+    looked++;
+    if (e >= capacity || hot[e] || pinned(e)) {
+      handCold = next[e];
+      continue;
+    }
+    if (refbit[e]) {
+      refbit[e] = false;
+      //move the page to the list head; unlink() advances hand cold
+      unlink(e);
+      link(e);
+      if (test[e]) {
+	//referenced in its test period: promote it
+	hot[e] = true;
+	test[e] = false;
+	numCold--;
+	numHot++;
+	for (int i = 0; numHot > numBufs - coldTarget && i < numBufs; i++)
+	  runHandHot();
+      } else {
+	test[e] = true;
+      }
+      continue;
+    }
+    handCold = next[e];
+    swept(looked);
+    return e;
+  }
+  //the cold pages are all pinned.  Rather than run hand hot until it
+  //turns an unpinned page cold, which can take a round per frame, turn
+  //the first unpinned hot page from hand hot on cold and take it.
+  int e = handHot;
+  for (int n = numHot + numCold + numNonResident; e != -1 && n > 0; n--) {
+    looked++;
+    if (e < capacity && hot[e] && !pinned(e)) {
+      hot[e] = false;
+      refbit[e] = false;
+      numHot--;
+      numCold++;
+      swept(looked);
+      return e;
+    }
+    e = next[e];
+  }
+  swept(looked);
+  return -1;
+}
+
+// the unreferenced cold pages ahead of hand cold
+void ClockProPolicy::nextVictims(vector<int>& frames, const int n)
+{
+  lock_guard<mutex> guard(latch);
+  frames.clear();
+  int e = handCold;
+  for (int i = numHot + numCold + numNonResident;
+       e != -1 && i > 0 && (int) frames.size() < n; i--, e = next[e])
+    if (e < capacity && !hot[e] && !refbit[e])
+      frames.push_back(e);
+}
+
+// the frames in question are unused; a smaller pool keeps fewer
+// non-resident pages and fewer hot ones
+void ClockProPolicy::resize(const int bufs)
+{
+  lock_guard<mutex> guard(latch);
+  for (int i = bufs; i < numBufs; i++)
+    unused.remove(i);
+  for (int i = numBufs; i < bufs; i++)
+    unused.pushFront(0, i);
+  numBufs = bufs;
+  coldTarget = min(max(1, bufs - 1), coldTarget);
+  runHandTest(bufs);
+  for (int i = 0; numHot > bufs - coldTarget && i < bufs; i++)
+    runHandHot();
+}
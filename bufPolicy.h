@@ -0,0 +1,325 @@
+#ifndef BUFPOLICY_H
+#define BUFPOLICY_H
+
+#include <list>
+#include <set>
+#include <vector>
+#include <unordered_map>
+#include "page.h"
+#include "buf.h"
+
+class FrameLists;
+
+// Replacement policy of a buffer pool: decides which frame allocBuf()
+// reuses.  BufMgr reports what happens to the frames:
+//
+//   accessed(f)   the page in f was found in the pool (a hit)
+//   loaded(f, id) page id was brought into f after a miss
+//   evicted(f)    the page in f was replaced to make room for another
+//   dropped(f)    the page in f left the pool for any other reason
+//                 (flushFile, disposePage, a failed read)
+//
+// victim() proposes a frame to replace.  It must not return a frame that
+// is pinned, but since nothing stops a thread from pinning the frame
+// right after, BufMgr claims it and asks again if that fails; nothing
+// about the frame changes until evicted() is called.  Frames that hold no
+// page (at start up, or after dropped()) should be proposed first.
+//
+// All methods may be called concurrently.  CLOCK needs no latch; the
+// other policies keep ordered lists and serialize on a mutex, but not on
+// hits: accessed() only sets a flag of the frame, and the hit is counted
+// under the mutex when victim() comes to the frame, as a reference at
+// that time.  Hits on a frame in between count once, and a frame victim()
+// has not come to yet may be ranked lower than it would be.
+//
+// The pool can grow and shrink (BufMgr::resize) between 1 and capacity
+// frames; the policy's arrays are sized for capacity.  resize(bufs) is
+// called when frames numBufs..bufs-1 are to be used too, or frames
+// bufs..numBufs-1 are given up.  Either way those frames hold no page and
+// stay claimed until resize() returns, and frames given up stay claimed
+// after: they are never accessed or loaded again, only proposed by a
+// victim() that is already under way.
+class BufPolicy
+{
+protected:
+  BufDesc* bufTable;  // the frames of the buffer pool
+  atomic<int> numBufs;  // number of frames
+  const int capacity;   // most frames the pool can have
+  BufMetrics* metrics;  // where to count SWEEP, may be NULL
+
+  // n more frames looked at for a victim
+  void swept(const int n) const
+  {
+      if (metrics && n > 0)
+	metrics->countId(0, SWEEP, n);
+  }
+
+  // a frame is pinned while it is in use or claimed by another thread
+  bool pinned(const int frame) const
+  {
+      return bufTable[frame].pinCnt != 0;
+  }
+  // the unpinned frame nearest to the back of list l, -1 if none.  With
+  // hit, a frame whose flag is set is moved to the front of list to
+  // instead, as its hits would have moved it, and its flag cleared.
+  int lastUnpinned(FrameLists& lists, const int l, atomic<bool>* hit = NULL,
+		   const int to = -1) const;
+  // append frames from the back of list l until frames holds n, but for
+  // those whose hit flag is set
+  void fromBack(const FrameLists& lists, const int l, vector<int>& frames,
+		const int n, const atomic<bool>* hit = NULL) const;
+
+public:
+  BufPolicy(BufDesc* table, const int bufs, const int capacity)
+    : bufTable(table), numBufs(bufs), capacity(capacity), metrics(NULL) {}
+  virtual ~BufPolicy() {}
+
+  // the policy of kind for a pool of bufs frames that may grow to
+  // capacity frames (0 for bufs), counting the frames it looks at in
+  // metrics
+  static BufPolicy* create(const ReplPolicy kind, BufDesc* table,
+			   const int bufs, BufMetrics* metrics = NULL,
+			   const int capacity = 0);
+  static const char* name(const ReplPolicy kind);
+
+  virtual void accessed(const int frame) = 0;
+  virtual void loaded(const int frame, const PageId id) = 0;
+  virtual void evicted(const int frame) = 0;
+  virtual void dropped(const int frame) = 0;
+
+    // frame to replace to make room for page incoming; -1 if all frames
+    // are pinned
+  virtual int victim(const PageId incoming) = 0;
+
+    // the frames victim() is likely to propose next, soonest first, at
+    // most n of them; changes nothing.  The background writer cleans
+    // these ahead of time.
+  virtual void nextVictims(vector<int>& frames, const int n) = 0;
+
+    // the pool has bufs frames from now on, see above
+  virtual void resize(const int bufs) = 0;
+};
+
+
+// doubly linked lists over the frames of a pool, a frame is on at most
+// one of them at a time.  Front is the most recently inserted end.
+class FrameLists
+{
+private:
+  int frames;
+  int* prev;   // links; node frames + l is the head of list l
+  int* next;
+  int* owner;  // list a frame is on, -1 if none
+  int* count;  // frames on each list
+
+public:
+  FrameLists(const int frames, const int lists);
+  ~FrameLists();
+
+  void pushFront(const int l, const int frame);
+  void remove(const int frame);  // take a frame off its list, if any
+
+  int  list(const int frame) const { return owner[frame]; }
+  int  size(const int l) const { return count[l]; }
+
+    // walking a list from its back: back(l), then before(), until the
+    // result is -1
+  int  back(const int l) const { return node(prev[frames + l]); }
+  int  before(const int frame) const { return node(prev[frame]); }
+
+private:
+  int  node(const int n) const { return n < frames ? n : -1; }
+};
+
+
+// page ids of pages that were evicted recently, oldest first; the
+// "ghost" entries of 2Q and ARC
+class GhostList
+{
+private:
+  list<PageId> order;
+  unordered_map<PageId, list<PageId>::iterator> where;
+
+public:
+  bool contains(const PageId id) const { return where.count(id) != 0; }
+  int  size() const { return (int) where.size(); }
+  void push(const PageId id);
+  void remove(const PageId id);
+  PageId popOldest();  // forget the oldest id and return it
+};
+
+
+// the single bit clock this buffer manager always used: a hit sets the
+// frame's reference bit, the hand clears set bits and takes the first
+// unpinned frame whose bit is clear
+class ClockPolicy : public BufPolicy
+{
+private:
+  atomic<unsigned int> clockHand;
+  atomic<bool>* refbit;  // has the frame been referenced recently
+
+public:
+  ClockPolicy(BufDesc* table, const int bufs, const int capacity);
+  ~ClockPolicy();
+
+  void accessed(const int frame);
+  void loaded(const int frame, const PageId id);
+  void evicted(const int frame);
+  void dropped(const int frame);
+  int  victim(const PageId incoming);
+  void nextVictims(vector<int>& frames, const int n);
+  void resize(const int bufs);
+};
+
+
+// LRU-K (O'Neil et al.): replaces the page whose K-th most recent
+// reference is oldest; pages with fewer than K references go first, in
+// LRU order.  The reference history of evicted pages is kept for as many
+// pages as the pool has frames, so a page that comes back soon keeps it.
+class LRUKPolicy : public BufPolicy
+{
+private:
+  typedef pair<unsigned long, unsigned long> Rank;  // (K-th, last) reference
+
+  mutex latch;
+  atomic<bool>* hit;              // frames hit since victim() came to them
+  int k;
+  unsigned long now;              // logical clock, one tick per reference
+  unsigned long* history;         // last k references of each frame, newest first
+  PageId* pages;                  // page in each frame
+  set<pair<Rank, int> > order;    // frames, first is the next victim
+  unordered_map<PageId, vector<unsigned long> > retained;
+  GhostList retainedOrder;        // pages with retained history, oldest first
+
+  Rank rank(const int frame) const;
+  void reference(const int frame); // record a reference, the frame is off order
+
+public:
+  LRUKPolicy(BufDesc* table, const int bufs, const int capacity,
+	     const int k = 2);
+  ~LRUKPolicy();
+
+  void accessed(const int frame);
+  void loaded(const int frame, const PageId id);
+  void evicted(const int frame);
+  void dropped(const int frame);
+  int  victim(const PageId incoming);
+  void nextVictims(vector<int>& frames, const int n);
+  void resize(const int bufs);
+};
+
+
+// full 2Q (Johnson and Shasha): new pages enter the FIFO A1in; pages
+// evicted from A1in are remembered in the ghost list A1out and go to the
+// LRU list Am when they are referenced again.  A scan only passes through
+// A1in and leaves Am alone.
+class TwoQPolicy : public BufPolicy
+{
+private:
+  enum { A1IN, AM, FREE };
+
+  mutex latch;
+  atomic<bool>* hit;  // frames hit since victim() came to them
+  int kin;          // target size of A1in
+  int kout;         // size of A1out
+  FrameLists lists;
+  GhostList a1out;
+  PageId* pages;    // page in each frame
+
+
+public:
+  TwoQPolicy(BufDesc* table, const int bufs, const int capacity);
+  ~TwoQPolicy();
+
+  void accessed(const int frame);
+  void loaded(const int frame, const PageId id);
+  void evicted(const int frame);
+  void dropped(const int frame);
+  int  victim(const PageId incoming);
+  void nextVictims(vector<int>& frames, const int n);
+  void resize(const int bufs);
+};
+
+
+// ARC (Megiddo and Modha): LRU lists T1 (seen once) and T2 (seen more
+// than once) plus ghost lists B1 and B2 of the pages evicted from them.
+// A miss that hits B1 grows the target size p of T1, one that hits B2
+// shrinks it, so the split between recency and frequency adapts to the
+// workload.
+class ARCPolicy : public BufPolicy
+{
+private:
+  enum { T1, T2, FREE };
+
+  mutex latch;
+  atomic<bool>* hit;  // frames hit since victim() came to them
+  int p;            // target size of T1
+  FrameLists lists;
+  GhostList b1, b2;
+  PageId* pages;    // page in each frame
+
+  void trimGhosts();
+
+public:
+  ARCPolicy(BufDesc* table, const int bufs, const int capacity);
+  ~ARCPolicy();
+
+  void accessed(const int frame);
+  void loaded(const int frame, const PageId id);
+  void evicted(const int frame);
+  void dropped(const int frame);
+  int  victim(const PageId incoming);
+  void nextVictims(vector<int>& frames, const int n);
+  void resize(const int bufs);
+};
+
+
+// CLOCK-Pro (Jiang, Chen and Zhang): one clock holding hot and cold
+// resident pages and cold pages that were evicted recently (non-resident,
+// kept for a test period).  A cold page referenced during its test period
+// becomes hot; a hit on a non-resident page grows the share of cold
+// frames, a test period ending without one shrinks it.  Three hands:
+// hand cold finds victims, hand hot turns hot pages cold and ends test
+// periods, hand test ends the test periods of non-resident pages.
+class ClockProPolicy : public BufPolicy
+{
+private:
+  mutex latch;
+  int coldTarget;       // adaptive target number of cold resident pages
+  int numHot, numCold, numNonResident;
+
+  // clock entries: 0..capacity-1 are the frames, capacity..2*capacity-1
+  // hold non-resident pages, at most numBufs of them
+  int* prev;
+  int* next;
+  bool* linked;         // entry is on the clock
+  bool* hot;
+  bool* test;           // in its test period
+  atomic<bool>* refbit; // frames only, set on hits without the latch
+  PageId* pages;
+  int* spare;           // unused non-resident entries
+  int numSpare;
+  unordered_map<PageId, int> nonResident;  // page to its entry
+  FrameLists unused;    // frames that hold no page, all on list 0
+  int handHot, handCold, handTest;  // -1 while the clock is empty
+
+  void link(const int e);    // insert e behind hand hot, the list head
+  void unlink(const int e);
+  void endTest(const int e); // end e's test period
+  void runHandHot();
+  void runHandTest(const int limit);
+
+public:
+  ClockProPolicy(BufDesc* table, const int bufs, const int capacity);
+  ~ClockProPolicy();
+
+  void accessed(const int frame);
+  void loaded(const int frame, const PageId id);
+  void evicted(const int frame);
+  void dropped(const int frame);
+  int  victim(const PageId incoming);
+  void nextVictims(vector<int>& frames, const int n);
+  void resize(const int bufs);
+};
+
+#endif
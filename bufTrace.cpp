@@ -0,0 +1,205 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include "bufTrace.h"
+
+// buffered records are written once there are this many bytes
+static const size_t TRACEBUFFER = 1 << 16;
+
+
+// numbers BufTraces, from 1
+static atomic<uint64_t> instances(0);
+
+
+BufTrace::BufTrace()
+  : on(false), seq(0), instance(++instances), fd(-1), failed(false)
+{
+}
+
+BufTrace::~BufTrace()
+{
+  stop();
+  for (auto it = buffers.begin(); it != buffers.end(); ++it)
+    delete it->second;
+}
+
+const Status BufTrace::start(const char* path)
+{
+  lock_guard<mutex> guard(latch);
+  {
+    lock_guard<mutex> fileGuard(fileLatch);
+    if (fd >= 0)
+      return FILEOPEN;
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+      return UNIXERR;
+    failed = false;
+  }
+  vector<char> magic(TRACEMAGIC, TRACEMAGIC + sizeof TRACEMAGIC - 1);
+  write(magic);
+  //what threads recorded after the last stop() is not part of this trace
+  for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+    lock_guard<mutex> bufGuard(it->second->latch);
+    it->second->data.clear();
+    it->second->named.clear();
+  }
+  named.clear();
+  seq = 0;
+  on = true;
+  return OK;
+}
+
+const Status BufTrace::stop()
+{
+  //a thread appends to its buffer only while on, so once its buffer has
+  //been written here it adds no more
+  on = false;
+  lock_guard<mutex> guard(latch);
+  {
+    lock_guard<mutex> fileGuard(fileLatch);
+    if (fd < 0)
+      return OK;
+  }
+  for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+    lock_guard<mutex> bufGuard(it->second->latch);
+    write(it->second->data);
+  }
+  lock_guard<mutex> fileGuard(fileLatch);
+  if (::close(fd) < 0)
+    failed = true;
+  fd = -1;
+  return failed ? UNIXERR : OK;
+}
+
+void BufTrace::closeFile(const File* file)
+{
+  lock_guard<mutex> guard(latch);
+  named.erase(file->getId());
+  for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+    lock_guard<mutex> bufGuard(it->second->latch);
+    it->second->named.erase(file->getId());
+  }
+}
+
+BufTrace::ThreadBuffer* BufTrace::mine()
+{
+  //a thread mostly records for one BufTrace: keep the last one's buffer
+  static thread_local uint64_t lastInstance = 0;
+  static thread_local ThreadBuffer* last = NULL;
+  if (lastInstance == instance)
+    return last;
+  lock_guard<mutex> guard(latch);
+  ThreadBuffer*& buf = buffers[this_thread::get_id()];
+  if (!buf)
+    buf = new ThreadBuffer;
+  lastInstance = instance;
+  last = buf;
+  return buf;
+}
+
+void BufTrace::add(const TraceOp op, const File* file, const int pageNo,
+		   const int flags)
+{
+  ThreadBuffer* buf = mine();
+  int id = file->getId();
+  //the first record of a file is its name; a thread looks in named for
+  //each id once, so its records are numbered after the name
+  unique_lock<mutex> bufGuard(buf->latch);
+  if (!buf->named.count(id)) {
+    bufGuard.unlock();
+    lock_guard<mutex> guard(latch);
+    bufGuard.lock();
+    if (!named.count(id) && isOn()) {
+      const string& name = file->getName();
+      TraceRecord rec = { TRACENAME, 0, 0, (uint32_t) id,
+			  (int32_t) name.size(), 0, seq.fetch_add(1) };
+      append(buf, &rec, sizeof rec);
+      append(buf, name.data(), name.size());
+      named.insert(id);
+    }
+    if (named.count(id))
+      buf->named.insert(id);
+  }
+  //stop() may have come first
+  if (!isOn())
+    return;
+  TraceRecord rec = { (uint8_t) op, (uint8_t) flags, 0, (uint32_t) id, pageNo,
+		      0, seq.fetch_add(1) };
+  append(buf, &rec, sizeof rec);
+}
+
+void BufTrace::append(ThreadBuffer* buf, const void* data, const size_t n)
+{
+  buf->data.insert(buf->data.end(), (const char*) data,
+		   (const char*) data + n);
+  if (buf->data.size() >= TRACEBUFFER)
+    write(buf->data);
+}
+
+void BufTrace::write(vector<char>& data)
+{
+  lock_guard<mutex> guard(fileLatch);
+  size_t done = 0;
+  while (done < data.size() && fd >= 0 && !failed) {
+    ssize_t n = ::write(fd, &data[done], data.size() - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      failed = true;
+    else
+      done += n;
+  }
+  data.clear();
+}
+
+
+TraceReader::TraceReader() : at(0)
+{
+}
+
+const Status TraceReader::open(const char* path)
+{
+  records.clear();
+  names.clear();
+  at = 0;
+  FILE* in = fopen(path, "rb");
+  if (!in)
+    return UNIXERR;
+  char magic[sizeof TRACEMAGIC - 1];
+  if (fread(magic, sizeof magic, 1, in) != 1 ||
+      memcmp(magic, TRACEMAGIC, sizeof magic) != 0) {
+    fclose(in);
+    return BADFILE;
+  }
+  TraceRecord rec;
+  while (fread(&rec, sizeof rec, 1, in) == 1) {
+    if (rec.op == TRACENAME) {
+      if (rec.pageNo < 0)
+	break;
+      string name(rec.pageNo, ' ');
+      if (rec.pageNo > 0 && fread(&name[0], rec.pageNo, 1, in) != 1)
+	break;
+      names[rec.seq] = name;
+    }
+    records.push_back(rec);
+  }
+  fclose(in);
+  //each thread's records are in order already; merge the batches
+  stable_sort(records.begin(), records.end(),
+	      [](const TraceRecord& a, const TraceRecord& b) {
+		return a.seq < b.seq;
+	      });
+  return OK;
+}
+
+bool TraceReader::next(TraceRecord& rec, string& name)
+{
+  if (at >= records.size())
+    return false;
+  rec = records[at++];
+  if (rec.op == TRACENAME)
+    name = names[rec.seq];
+  return true;
+}
@@ -0,0 +1,124 @@
+#ifndef BUFTRACE_H
+#define BUFTRACE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include "page.h"
+#include "db.h"
+
+// the calls a BufTrace records; calls that fail are not
+enum TraceOp {
+  TRACEREAD,     // readPage(), and readPages() for each page
+  TRACEALLOC,    // allocPage(); the page number is the one allocated
+  TRACEUNPIN,    // unPinPage() or a PageHandle letting go; flags dirty
+  TRACEDISPOSE,  // disposePage()
+  TRACEFLUSH,    // flushFile(); page number 0
+  TRACENAME      // names a file id, see below
+};
+
+// flags of a record
+const int TRACEDIRTY = 1;
+
+// A trace file starts with the 8 bytes TRACEMAGIC and then holds one
+// TraceRecord per call, numbered by seq in the order the calls were made;
+// the records of each thread are written in batches, so the file need
+// not be in that order.  Before the first record for a file id a
+// TRACENAME record has the id in file and the length of the file's name
+// in pageNo, and the name follows it.  File ids are not reused (see
+// DB::openFile), so a file reopened is named again under its new id.
+const char TRACEMAGIC[] = "BUFTRC03";
+
+struct TraceRecord
+{
+  uint8_t  op;
+  uint8_t  flags;
+  uint16_t unused;  // 0
+  uint32_t file;
+  int32_t  pageNo;
+  uint32_t unused2; // 0
+  uint64_t seq;
+};
+
+// Records the calls made to a BufMgr in a trace file.  Off to begin with;
+// when off, record() costs a load.  Each thread collects its records in
+// a buffer of its own, written to the file when full or on stop(), so
+// threads only meet on the counter that numbers the calls of all of them
+// in one order.
+class BufTrace
+{
+public:
+  BufTrace();
+  ~BufTrace();
+
+  // start writing the trace to a new file
+  // @return OK, UNIXERR if the file cannot be created, or FILEOPEN if
+  //         a trace is being written already
+  const Status start(const char* path);
+  // stop tracing and close the file
+  // @return OK, or UNIXERR if any of the trace could not be written
+  const Status stop();
+  bool isOn() const { return on.load(memory_order_relaxed); }
+
+  void record(const TraceOp op, const File* file, const int pageNo,
+	      const int flags = 0)
+  {
+    if (isOn())
+      add(op, file, pageNo, flags);
+  }
+  // the file is being closed; forget its id
+  void closeFile(const File* file);
+
+private:
+  // the records of a thread not written yet
+  struct ThreadBuffer
+  {
+    mutex latch;           // taken by the thread, and by start(), stop()
+                           // and closeFile()
+    vector<char> data;
+    set<int> named;        // of named, the ids the thread has seen there
+  };
+
+  atomic<bool> on;
+  atomic<uint64_t> seq;    // of the next record
+  set<int> named;          // ids of open files with a TRACENAME record
+  const uint64_t instance; // tells BufTraces apart in threads' caches
+  mutex latch;             // protects buffers and named
+  map<thread::id, ThreadBuffer*> buffers;
+  mutex fileLatch;         // protects fd and failed
+  int fd;
+  bool failed;             // a write went wrong
+
+  ThreadBuffer* mine();    // the calling thread's buffer
+  void add(const TraceOp op, const File* file, const int pageNo,
+	   const int flags);
+  void append(ThreadBuffer* buf, const void* data, const size_t n);
+  void write(vector<char>& data);  // to the file, and clear it
+};
+
+// Reads a trace file written by BufTrace, in the order of the calls;
+// open() reads it all
+class TraceReader
+{
+public:
+  TraceReader();
+
+  // @return OK, UNIXERR if the file cannot be read, or BADFILE if it is
+  //         not a trace; a trace cut short is read up to the cut
+  const Status open(const char* path);
+  // the next record; the name a TRACENAME record gives goes to name
+  // @return false at the end of the trace
+  bool next(TraceRecord& rec, string& name);
+
+private:
+  vector<TraceRecord> records;   // by seq
+  map<uint64_t, string> names;   // of the TRACENAME records, by seq
+  size_t at;                     // of the next record
+};
+
+#endif
@@ -3,16 +3,24 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
 #include <iostream>
 #include <math.h>
+#include <algorithm>
 #include <stdio.h>
 #include "page.h"
 #include "db.h"
 #include "buf.h"
+#include "ioEngine.h"
 
 
 #define DBP(p)      (*(DBPage*)&p)
 
+// words of a bitmap page
+const int MAPWORDS = BITMAPPAGES / 64;
+static_assert(BITMAPPAGES == 8 * sizeof(Page), "a bitmap fills a page");
+
 // openfile hash table implementation
 OpenFileHashTbl::OpenFileHashTbl()
 {
@@ -131,6 +139,13 @@ File::File(const string & fname)
   fileName = fname;
   openCnt = 0;
   unixFile = -1;
+  fileId = 0;
+  direct = false;
+  bufferedFile = -1;
+  ioLatency = NULL;
+  hdrDirty = false;
+  freeHint = 0;
+  diskPages = 0;
 }
 
 // Deallocate a file object
@@ -152,7 +167,7 @@ File::~File()
     }
 }
 
-Status const File::create(const string & fileName)
+Status const File::create(const string & fileName, const FileFormat format)
 {
   int file;
   if ((file = ::open(fileName.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0666)) < 0)
@@ -163,14 +178,18 @@ Status const File::create(const string & fileName)
 	return UNIXERR;
     }
 
-  // An empty file contains just a DB header page.
-
-  Page header;
-  memset(&header, 0, sizeof header);
-  DBP(header).nextFree = -1;
-  DBP(header).firstPage = -1;
-  DBP(header).numPages = 1;
-  if (write(file, (char*)&header, sizeof header) != sizeof header)
+  // An empty file contains just a DB header page, and in a FREEBITMAP
+  // file the first bitmap, with the bits of the two set.
+
+  alignas(DIRECTALIGN) Page header[2];
+  memset(header, 0, sizeof header);
+  DBP(header[0]).nextFree = -1;
+  DBP(header[0]).firstPage = -1;
+  DBP(header[0]).numPages = format == FREEBITMAP ? 2 : 1;
+  DBP(header[0]).format = format;
+  *(uint64_t*)&header[1] = 3;
+  ssize_t size = DBP(header[0]).numPages * sizeof(Page);
+  if (write(file, (char*)header, size) != size)
     return UNIXERR;
 
   if (::close(file) < 0)
@@ -190,7 +209,7 @@ const Status File::destroy(const string & fileName)
   return OK;
 }
 
-const Status File::open()
+const Status File::open(const bool direct)
 {
   // Open file -- it will be closed in closeFile().
 
@@ -199,6 +218,51 @@ const Status File::open()
       if ((unixFile = ::open(fileName.c_str(), O_RDWR)) < 0)
 	return UNIXERR;
 
+      // In direct mode the pages bypass the kernel's cache, so that the
+      // buffer pool is the only copy in memory.  The buffered descriptor
+      // stays open for requests O_DIRECT rejects; file systems that do
+      // not support it at all leave the file buffered.
+      this->direct = false;
+      if (direct) {
+	int fd = ::open(fileName.c_str(), O_RDWR | O_DIRECT);
+	if (fd >= 0) {
+	  bufferedFile = unixFile;
+	  unixFile = fd;
+	  this->direct = true;
+	}
+      }
+
+      // Keep the header page in memory while the file is open, and the
+      // bitmaps of a FREEBITMAP file.
+
+      alignas(DIRECTALIGN) Page page;
+      Status status = intread(0, &page, ioLatency);
+      header = DBP(page);
+      struct stat st;
+      if (status == OK && fstat(unixFile, &st) < 0)
+	status = UNIXERR;
+      diskPages = status == OK ?
+	max((int)(st.st_size / sizeof(Page)), header.numPages) : 0;
+      usedMap.clear();
+      mapDirty.clear();
+      freeHint = 0;
+      if (status == OK && header.format == FREEBITMAP) {
+	int maps = (header.numPages + BITMAPPAGES - 1) / BITMAPPAGES;
+	usedMap.resize(maps * MAPWORDS);
+	mapDirty.assign(maps, false);
+	for (int g = 0; g < maps && status == OK; g++)
+	  if ((status = intread(mapPage(g), &page, ioLatency)) == OK)
+	    memcpy(&usedMap[g * MAPWORDS], &page, sizeof page);
+      }
+      if (status != OK) {
+	if (bufferedFile >= 0)
+	  ::close(bufferedFile);
+	bufferedFile = -1;
+	::close(unixFile);
+	return status;
+      }
+      hdrDirty = false;
+
       // Store file info in open files table.
 
       openCnt = 1;
@@ -220,62 +284,136 @@ const Status File::close()
 
   if (openCnt == 0) {
 
-    if (bufMgr)
-      bufMgr->flushFile(this);
+    // The file stays open if its pages cannot all be flushed, e.g. when
+    // one is still pinned.
+
+    if (bufMgr) {
+      Status status = bufMgr->flushFile(this);
+      if (status != OK) {
+	openCnt++;
+	return status;
+      }
+      bufMgr->fileClosed(this);
+    }
+    Status status = flushHeader();
+
+    // Give back the room the file grew by and did not use.
 
+    if (status == OK && diskPages > header.numPages &&
+	ftruncate(unixFile, (off_t)header.numPages * sizeof(Page)) < 0)
+      status = UNIXERR;
+
+    if (bufferedFile >= 0 && ::close(bufferedFile) < 0)
+      return UNIXERR;
+    bufferedFile = -1;
     if (::close(unixFile) < 0)
       return UNIXERR;
+    return status;
   }
 
   return OK;
 }
 
 
+// Write the header page back if allocatePage() or disposePage() changed
+// it since it was last written, and before it the bitmaps they changed.
+
+const Status File::flushHeader() const
+{
+  lock_guard<mutex> guard(hdrLatch);
+  if (!hdrDirty)
+    return OK;
+
+  alignas(DIRECTALIGN) Page page;
+  for (size_t g = 0; g < mapDirty.size(); g++)
+    if (mapDirty[g]) {
+      memcpy((char*)&page, &usedMap[g * MAPWORDS], sizeof page);
+      Status status = ((File*)this)->intwrite(mapPage(g), &page, ioLatency);
+      if (status != OK)
+	return status;
+      mapDirty[g] = false;
+    }
+
+  memset(&page, 0, sizeof page);
+  DBP(page) = header;
+  Status status = ((File*)this)->intwrite(0, &page, ioLatency);
+  if (status == OK)
+    hdrDirty = false;
+  return status;
+}
+
+
 // Allocate a page either from a free list (list of pages which
 // were previously disposed of), or extend file if no free pages
 // are available.
 
 Status File::allocatePage(int& pageNo)
 {
-  Page header;
-  Status status;
+  return allocatePages(1, pageNo);
+}
 
-  if ((status = intread(0, &header)) != OK)
-    return status;
 
-  // If free list has pages on it, take one from there
-  // and adjust free list accordingly.
+// Allocate n consecutive pages, firstPageNo to firstPageNo + n - 1.  A
+// FREELIST file takes a single page off its free list if it can, a
+// FREEBITMAP file the first n free pages in a row it has; otherwise the
+// file is extended.  A bitmap page can be in no such run, so n must be
+// below BITMAPPAGES in a FREEBITMAP file.
 
-  if (DBP(header).nextFree != -1) {     // free list exists?
+Status File::allocatePages(const int n, int& firstPageNo)
+{
+  Status status;
+  lock_guard<mutex> guard(hdrLatch);
+  bool bitmap = header.format == FREEBITMAP;
+  if (n < 1 || (bitmap && n >= BITMAPPAGES))
+    return BADPAGENO;
+
+  int pageNo = -1;
+  if (bitmap)
+    pageNo = findFree(n);
+  else if (n == 1 && header.nextFree != -1) {   // free list exists?
 
     // Return first page on free list to the caller,
     // adjust free list accordingly.
 
-    pageNo = DBP(header).nextFree;
-    Page firstFree;
-    if ((status = intread(pageNo, &firstFree)) != OK)
+    alignas(DIRECTALIGN) Page firstFree;
+    if ((status = intread(header.nextFree, &firstFree, ioLatency)) != OK)
       return status;
-    DBP(header).nextFree = DBP(firstFree).nextFree;
+    pageNo = header.nextFree;
+    header.nextFree = DBP(firstFree).nextFree;
+  }
 
-  } else {                              // no free list, have to extend file
+  if (pageNo == -1) {                   // have to extend file
 
     // Extend file -- the current number of pages will be
-    // the page number of the page to be returned.
-
-    pageNo = DBP(header).numPages;
-    Page newPage;
-    memset(&newPage, 0, sizeof newPage);
-    if ((status = intwrite(pageNo, &newPage)) != OK)
+    // the page number of the first page to be returned, unless a
+    // bitmap page is due there or among the pages: then the pages
+    // start after it, and those skipped are left free.
+
+    pageNo = header.numPages;
+    if (bitmap && pageNo % BITMAPPAGES == 0)
+      pageNo++;
+    else if (bitmap && pageNo / BITMAPPAGES != (pageNo + n - 1) / BITMAPPAGES)
+      pageNo = (pageNo / BITMAPPAGES + 1) * BITMAPPAGES + 1;
+    if ((status = extend(pageNo + n)) != OK)
       return status;
+    header.numPages = pageNo + n;
 
-    DBP(header).numPages++;
+    for (int g = mapDirty.size(); bitmap && g <= pageNo / BITMAPPAGES; g++) {
+      usedMap.resize((g + 1) * MAPWORDS, 0);
+      mapDirty.push_back(true);
+      setUsed(mapPage(g), true);
+    }
 
-    if (DBP(header).firstPage == -1)    // first user page in file?
-      DBP(header).firstPage = pageNo;
+    if (header.firstPage == -1)         // first user page in file?
+      header.firstPage = pageNo;
   }
 
-  if ((status = intwrite(0, &header)) != OK)
-    return status;
+  for (int i = 0; bitmap && i < n; i++)
+    setUsed(pageNo + i, true);
+  firstPageNo = pageNo;
+
+  // the header is written back later, see flushHeader()
+  hdrDirty = true;
   
 #ifdef DEBUGFREE
   listFree();
@@ -285,6 +423,46 @@ Status File::allocatePage(int& pageNo)
 }
 
 
+// Set or clear the bit of a page in the bitmaps of a FREEBITMAP file.
+
+void File::setUsed(const int pageNo, const bool used)
+{
+  uint64_t bit = (uint64_t)1 << (pageNo % 64);
+  if (used)
+    usedMap[pageNo / 64] |= bit;
+  else {
+    usedMap[pageNo / 64] &= ~bit;
+    freeHint = min(freeHint, pageNo / 64);
+  }
+  mapDirty[pageNo / BITMAPPAGES] = true;
+}
+
+
+// Return the first of the lowest n free pages in a row in a FREEBITMAP
+// file, or -1 if it has none.  Words of pages all in use are skipped
+// whole.
+
+int File::findFree(const int n)
+{
+  const uint64_t full = ~(uint64_t)0;
+  int words = (header.numPages + 63) / 64;
+  while (freeHint < words && usedMap[freeHint] == full)
+    freeHint++;
+
+  int run = 0;
+  for (int p = freeHint * 64; p < header.numPages; p++) {
+    if (p % 64 == 0 && usedMap[p / 64] == full) {
+      run = 0;
+      p += 63;
+    } else if (isUsed(p))
+      run = 0;
+    else if (++run == n)
+      return p - n + 1;
+  }
+  return -1;
+}
+
+
 // Deallocate a page from file. The page will be put on a free
 // list and returned back to the caller upon a subsequent
 // allocPage() call.
@@ -294,33 +472,42 @@ const Status File::disposePage(const int pageNo)
   if (pageNo < 1)
     return BADPAGENO;
 
-  Page header;
   Status status;
-
-  if ((status = intread(0, &header)) != OK)
-    return status;
+  lock_guard<mutex> guard(hdrLatch);
 
   // The first user-allocated page in the file cannot be
   // disposed of. The File layer has no knowledge of what
   // is the next page in the file and hence would not be
   // able to adjust the firstPage field in file header.
 
-  if (DBP(header).firstPage == pageNo || pageNo >= DBP(header).numPages)
+  if (header.firstPage == pageNo || pageNo >= header.numPages)
     return BADPAGENO;
 
-  // Deallocate page by attaching it to the free list.
+  // In a FREEBITMAP file just the page's bit is cleared; it must be set,
+  // and not that of a bitmap page.
 
-  Page away;
-  if ((status = intread(pageNo, &away)) != OK)
-    return status;
+  if (header.format == FREEBITMAP) {
+    if (pageNo == mapPage(pageNo / BITMAPPAGES) || !isUsed(pageNo))
+      return BADPAGENO;
+    setUsed(pageNo, false);
+    hdrDirty = true;
+#ifdef DEBUGFREE
+    listFree();
+#endif
+    return OK;
+  }
+
+  // Deallocate page by attaching it to the free list.  The page's old
+  // contents are of no interest, it is overwritten with the link.
+
+  alignas(DIRECTALIGN) Page away;
   memset(&away, 0, sizeof away);
-  DBP(away).nextFree = DBP(header).nextFree;
-  DBP(header).nextFree = pageNo;
+  DBP(away).nextFree = header.nextFree;
 
-  if ((status = intwrite(pageNo, &away)) != OK)
-    return status;
-  if ((status = intwrite(0, &header)) != OK)
+  if ((status = intwrite(pageNo, &away, ioLatency)) != OK)
     return status;
+  header.nextFree = pageNo;
+  hdrDirty = true;
 
 #ifdef DEBUGFREE
   listFree();
@@ -330,15 +517,85 @@ const Status File::disposePage(const int pageNo)
 }
 
 
-// Read a page from file and store page contents at the page address
-// provided by the caller.
+// Read or write one page with positioned I/O, so that several threads
+// can use the file at the same time.  In direct mode a page that is not
+// aligned for O_DIRECT goes through an aligned copy, and requests the
+// device rejects nevertheless go through the buffered descriptor.
+
+ssize_t File::pageIO(const bool write, const int pageNo, Page* pagePtr) const
+{
+  off_t offset = (off_t)pageNo * sizeof(Page);
+  if (!direct)
+    return write ? pwrite(unixFile, (char*)pagePtr, sizeof(Page), offset)
+                 : pread(unixFile, (char*)pagePtr, sizeof(Page), offset);
+
+  alignas(DIRECTALIGN) static thread_local Page bounce;
+  Page* buf = pagePtr;
+  if ((uintptr_t)pagePtr % DIRECTALIGN != 0) {
+    buf = &bounce;
+    if (write)
+      memcpy(buf, pagePtr, sizeof(Page));
+  }
+  ssize_t nbytes = write ? pwrite(unixFile, (char*)buf, sizeof(Page), offset)
+                         : pread(unixFile, (char*)buf, sizeof(Page), offset);
+  if (nbytes < 0 && errno == EINVAL)
+    return write ? pwrite(bufferedFile, (char*)pagePtr, sizeof(Page), offset)
+                 : pread(bufferedFile, (char*)pagePtr, sizeof(Page), offset);
+  if (!write && buf != pagePtr && nbytes > 0)
+    memcpy(pagePtr, buf, nbytes);
+  return nbytes;
+}
+
+
+// Make room in the file for the pages below end.  The file grows by a
+// quarter of its size at a time, and by FILEGROWTH pages at least, with
+// fallocate(), which reserves the space without writing it; the pages
+// read as zeros.  Where fallocate() is not supported just the pages up
+// to end are written, with zeros.
 
-const Status File::intread(int pageNo, Page* pagePtr) const
+const Status File::extend(const int end)
 {
-  if (lseek(unixFile, pageNo * sizeof(Page), SEEK_SET) == -1)
+  if (end <= diskPages)
+    return OK;
+
+  int size = max(end, diskPages + max(FILEGROWTH, diskPages / 4));
+  if (fallocate(unixFile, 0, (off_t)diskPages * sizeof(Page),
+		(off_t)(size - diskPages) * sizeof(Page)) == 0) {
+    diskPages = size;
+    return OK;
+  }
+  if (errno != EOPNOTSUPP && errno != ENOSYS)
     return UNIXERR;
 
-  int nbytes = read(unixFile, (char*)pagePtr, sizeof(Page));
+  Status status = zeroPages(diskPages, end - diskPages);
+  if (status == OK)
+    diskPages = end;
+  return status;
+}
+
+
+// Write n zero pages from pageNo on.
+
+const Status File::zeroPages(const int pageNo, const int n)
+{
+  alignas(DIRECTALIGN) static const Page zero = Page();
+  if (n == 1)
+    return intwrite(pageNo, &zero, ioLatency);
+  vector<const Page*> pages(n, &zero);
+  return writePages(pageNo, &pages[0], n);
+}
+
+
+// Read a page from file and store page contents at the page address
+// provided by the caller.
+
+const Status File::intread(int pageNo, Page* pagePtr,
+			   BufLatency* latency) const
+{
+  uint64_t start = latency ? latency->start() : 0;
+  int nbytes = pageIO(false, pageNo, pagePtr);
+  if (start)
+    latency->record(FILEREAD, start);
 
 #ifdef DEBUGIO
   cerr << "%%  File " << (int)this << ": read bytes ";
@@ -359,12 +616,13 @@ const Status File::intread(int pageNo, Page* pagePtr) const
 // Write a page to file. Page data is at the page address
 // provided by the caller.
 
-const Status File::intwrite(const int pageNo, const Page* pagePtr)
+const Status File::intwrite(const int pageNo, const Page* pagePtr,
+			    BufLatency* latency)
 {
-  if (lseek(unixFile, pageNo * sizeof(Page), SEEK_SET) == -1)
-    return UNIXERR;
-
-  int nbytes = write(unixFile, (char*)pagePtr, sizeof(Page));
+  uint64_t start = latency ? latency->start() : 0;
+  int nbytes = pageIO(true, pageNo, (Page*)pagePtr);
+  if (start)
+    latency->record(FILEWRITE, start);
 
 #ifdef DEBUGIO
   cerr << "%%  File " << (int)this << ": wrote bytes ";
@@ -384,27 +642,107 @@ const Status File::intwrite(const int pageNo, const Page* pagePtr)
 
 // Read a page from file, check parameters for validity.
 
-const Status File::readPage(const int pageNo, Page* pagePtr) const
+const Status File::readPage(const int pageNo, Page* pagePtr,
+			    BufLatency* latency) const
 {
   if (!pagePtr)
     return BADPAGEPTR;
   if (pageNo < 1)
     return BADPAGENO;
 
-  return intread(pageNo, pagePtr);
+  return intread(pageNo, pagePtr, latency);
 }
 
 
 // Write a page to file, check parameters for validity.
 
-const Status File::writePage(const int pageNo, const Page *pagePtr)
+const Status File::writePage(const int pageNo, const Page *pagePtr,
+			     BufLatency* latency)
 {
   if (!pagePtr)
     return BADPAGEPTR;
   if (pageNo < 1)
     return BADPAGENO;
 
-  return intwrite(pageNo, pagePtr);
+  return intwrite(pageNo, pagePtr, latency);
+}
+
+
+// Write pages pageNo to pageNo + n - 1 to file with as few system calls
+// as possible.  The pages need not be next to each other in memory.
+
+const Status File::writePages(const int pageNo, const Page* const pagePtrs[],
+			      const int n)
+{
+  if (!pagePtrs)
+    return BADPAGEPTR;
+  if (pageNo < 1)
+    return BADPAGENO;
+
+  const int maxIov = 256;
+  struct iovec iov[maxIov];
+  int done = 0;
+  while (done < n) {
+    int cnt = min(n - done, maxIov);
+    bool aligned = true;
+    for (int i = 0; i < cnt; i++) {
+      if (!pagePtrs[done + i])
+	return BADPAGEPTR;
+      iov[i].iov_base = (void*)pagePtrs[done + i];
+      iov[i].iov_len = sizeof(Page);
+      aligned = aligned && (uintptr_t)pagePtrs[done + i] % DIRECTALIGN == 0;
+    }
+    // direct I/O wants every page aligned; else write them one by one
+    if (direct && !aligned) {
+      Status status;
+      for (int i = 0; i < cnt; i++)
+	if ((status = intwrite(pageNo + done + i, pagePtrs[done + i],
+			       ioLatency)) != OK)
+	  return status;
+      done += cnt;
+      continue;
+    }
+    off_t offset = (off_t)(pageNo + done) * sizeof(Page);
+    ssize_t nbytes = pwritev(unixFile, iov, cnt, offset);
+    if (nbytes < 0 && errno == EINVAL && direct)
+      nbytes = pwritev(bufferedFile, iov, cnt, offset);
+    // a short write leaves the rest, from the first partial page on, for
+    // the next call
+    if (nbytes < (ssize_t)sizeof(Page))
+      return UNIXERR;
+    done += nbytes / sizeof(Page);
+  }
+
+  return OK;
+}
+
+
+// Fill in an IOEngine request for pages pageNo to pageNo + n - 1, held
+// in the n buffers of iov.  In direct mode buffers that are not aligned
+// for O_DIRECT go through the buffered descriptor instead; the engine
+// cannot bounce them.  The others go there if the device rejects them,
+// as pageIO() does it (see IOEngine).
+
+const Status File::ioRequest(IORequest& req, const bool write,
+			     const int pageNo, struct iovec* iov,
+			     const int n, BufLatency* latency) const
+{
+  if (!iov)
+    return BADPAGEPTR;
+  if (pageNo < 1 || n < 1)
+    return BADPAGENO;
+
+  bool aligned = true;
+  for (int i = 0; i < n && aligned; i++)
+    aligned = (uintptr_t)iov[i].iov_base % DIRECTALIGN == 0;
+  req.fd = direct && !aligned ? bufferedFile : unixFile;
+  req.fallbackFd = req.fd == unixFile && direct ? bufferedFile : -1;
+  req.write = write;
+  req.offset = (off_t)pageNo * sizeof(Page);
+  req.iov = iov;
+  req.iovcnt = n;
+  req.latency = latency;
+  return OK;
 }
 
 
@@ -413,13 +751,8 @@ const Status File::writePage(const int pageNo, const Page *pagePtr)
 
 const Status File::getFirstPage(int& pageNo) const
 {
-  Page header;
-  Status status;
-
-  if ((status = intread(0, &header)) != OK)
-    return status;
-
-  pageNo = DBP(header).firstPage;
+  lock_guard<mutex> guard(hdrLatch);
+  pageNo = header.firstPage;
 
   return OK;
 }
@@ -432,15 +765,23 @@ const Status File::getFirstPage(int& pageNo) const
 void File::listFree()
 {
   cerr << "%%  File " << (int)this << " free pages:";
-  int pageNo = 0;
-  for(int i = 0; i < 10; i++) {
-    Page page;
+  if (header.format == FREEBITMAP) {
+    for (int p = 0, i = 0; p < header.numPages && i < 10; p++)
+      if (!isUsed(p)) {
+	cerr << " " << p;
+	i++;
+      }
+    cerr << endl;
+    return;
+  }
+  int pageNo = header.nextFree;
+  cerr << " " << pageNo;
+  for(int i = 0; i < 9 && pageNo != -1; i++) {
+    alignas(DIRECTALIGN) Page page;
     if (intread(pageNo, &page) != OK)
       break;
     pageNo = DBP(page).nextFree;
     cerr << " " << pageNo;
-    if (pageNo == -1)
-      break;
   }
   cerr << endl;
 }
@@ -452,6 +793,8 @@ void File::listFree()
 
 DB::DB()
 {
+  numIds = 0;
+
   // Check that DB header page data fits on a regular data page.
 
   if (sizeof(DBPage) >= sizeof(Page)) {
@@ -472,9 +815,10 @@ DB::~DB()
 
 
   
-// Create a database file.
+// Create a database file that keeps track of its free pages as format
+// says.
 
-const Status DB::createFile(const string &fileName) 
+const Status DB::createFile(const string &fileName, const FileFormat format)
 {
   File*  file;
   if (fileName.empty())
@@ -484,7 +828,7 @@ const Status DB::createFile(const string &fileName)
   if (openFiles.find(fileName, file) == OK) return FILEEXISTS;
 
   // Do the actual work
-  return File::create(fileName);
+  return File::create(fileName, format);
 }
 
 
@@ -506,9 +850,11 @@ const Status DB::destroyFile(const string & fileName)
 
 // Open a database file. If file already open, increment open count,
 // otherwise find a vacant slot in the open files table and store
-// file info there.
+// file info there.  With direct set a file not yet open is opened for
+// direct I/O (see File::open).
 
-const Status DB::openFile(const string & fileName, File*& filePtr)
+const Status DB::openFile(const string & fileName, File*& filePtr,
+			  const bool direct)
 {
   Status status;
   File* file;
@@ -528,7 +874,7 @@ const Status DB::openFile(const string & fileName, File*& filePtr)
       // file is not already open
       // Otherwise create a new file object and open it
       filePtr = new File(fileName);
-      status = filePtr->open();
+      status = filePtr->open(direct);
 
       if (status != OK)
 	{
@@ -536,6 +882,11 @@ const Status DB::openFile(const string & fileName, File*& filePtr)
 	  return status;
 	}
 
+      // Give the file an id; the buffer manager identifies pages by
+      // (file id, page number).  Ids are not reused: the pool's ghost
+      // lists and samples may still hold pages of files closed.
+      filePtr->fileId = ++numIds;
+
       // Insert into the mapping table
       status = openFiles.insert(fileName, filePtr);
     }
@@ -552,7 +903,7 @@ const Status DB::closeFile(File* file)
 
 
   // Close the file
-  file->close();
+  Status status = file->close();
 
   // If there are no remaining references to the file, then we should delete
   // the file object and remove it from the openFilesMap
@@ -563,5 +914,5 @@ const Status DB::closeFile(File* file)
       delete file;
     }
 
-  return OK;
+  return status;
 }
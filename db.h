@@ -2,7 +2,10 @@
 #define DB_H
 
 #include <sys/types.h>
+#include <stdint.h>
 #include <functional>
+#include <mutex>
+#include <vector>
 #include "error.h"
 #include <string.h>
 using namespace std;
@@ -14,6 +17,35 @@ using namespace std;
 
 // forward class definition for db
 class DB;
+struct IORequest;  // see ioEngine.h
+class BufLatency;  // see bufMetrics.h
+struct iovec;
+
+// alignment of buffers, file offsets and lengths that O_DIRECT I/O needs
+const int DIRECTALIGN = 512;
+
+// how a file keeps track of its free pages, chosen when it is created
+enum FileFormat {
+  FREELIST = 0,   // a list threaded through the free pages, from nextFree
+  FREEBITMAP      // a bit per page on bitmap pages
+};
+
+// pages a bitmap page has bits for, a page's worth: bitmap g has those
+// of pages BITMAPPAGES * g to BITMAPPAGES * (g + 1) - 1 and is the first
+// of them, but for bitmap 0, which comes after the header, on page 1
+const int BITMAPPAGES = 8 * 1024;
+
+// fewest pages a file grows by at a time, see File::extend()
+const int FILEGROWTH = 256;
+
+// structure of DB (header) page
+
+typedef struct {
+  int nextFree;                         // page # of next page on free list
+  int firstPage;                        // page # of first page in file
+  int numPages;                         // total # of pages in file
+  int format;                           // a FileFormat
+} DBPage;
 
 // class definition for open files
 class File {
@@ -23,12 +55,27 @@ class File {
  public:
 
   Status allocatePage(int& pageNo);     // allocate a new page
+  Status allocatePages(const int n,
+		       int& firstPageNo);   // allocate n consecutive pages
   const Status disposePage(const int pageNo);       // release space for a page
-  const Status readPage(const int pageNo,
-		  Page* pagePtr) const;       // read page from file
-  const Status writePage(const int pageNo,
-		   const Page* pagePtr);      // write page to file
+  const Status readPage(const int pageNo, Page* pagePtr,
+		  BufLatency* latency = NULL) const;  // read page from file,
+                                      // timed in latency if given
+  const Status writePage(const int pageNo, const Page* pagePtr,
+		   BufLatency* latency = NULL);  // write page to file
+  const Status writePages(const int pageNo, const Page* const pagePtrs[],
+		    const int n);             // write n consecutive pages
+  const Status ioRequest(IORequest& req, const bool write, const int pageNo,
+		   struct iovec* iov, const int n,
+		   BufLatency* latency = NULL) const; // set up async I/O of
+                                      // n consecutive pages
   const Status getFirstPage(int& pageNo) const;     // returns pageNo of first page
+  const Status flushHeader() const;   // write the header page back if changed
+  int getId() const { return fileId; }  // id, never given to another file
+  const string& getName() const { return fileName; }
+  bool isDirect() const { return direct; }  // I/O bypasses the kernel's cache
+  void setLatency(BufLatency* latency)   // time the I/O of the header,
+    { ioLatency = latency; }             // free list and bitmap pages
 
   bool operator == (const File & other) const
     {
@@ -40,16 +87,28 @@ class File {
   File(const string &fname);                   // initialize
   ~File();                  // deallocate file object
 
-  static const Status create(const string &fileName);
+  static const Status create(const string &fileName,
+			     const FileFormat format = FREELIST);
   static const Status destroy(const string &fileName);
 
-  const Status open();
+  const Status open(const bool direct = false);
   const Status close();
 
-  const Status intread(const int pageNo,
-		 Page* pagePtr) const;        // internal file read
-  const Status intwrite(const int pageNo,
-		  const Page* pagePtr);       // internal file write
+  const Status intread(const int pageNo, Page* pagePtr,
+		 BufLatency* latency = NULL) const;  // internal file read
+  const Status intwrite(const int pageNo, const Page* pagePtr,
+		  BufLatency* latency = NULL);  // internal file write
+  ssize_t pageIO(const bool write, const int pageNo,
+		 Page* pagePtr) const;        // pread/pwrite of one page
+  const Status zeroPages(const int pageNo,
+		   const int n);              // write n zero pages
+  const Status extend(const int end);   // make room for pages below end
+  static int mapPage(const int group)   // page # of a bitmap page
+    { return group == 0 ? 1 : group * BITMAPPAGES; }
+  bool isUsed(const int pageNo) const
+    { return usedMap[pageNo / 64] >> (pageNo % 64) & 1; }
+  void setUsed(const int pageNo, const bool used);
+  int findFree(const int n);            // first of n free pages in file
 
 #ifdef DEBUGFREE
   void listFree();                      // list free pages
@@ -58,6 +117,29 @@ class File {
   string fileName;                    // The name of the file
   int openCnt;                        // # times file has been opened
   int unixFile;                       // unix file stream for file
+  int fileId;                         // id given by DB::openFile, from 1 up
+  bool direct;                        // unixFile was opened with O_DIRECT
+  int bufferedFile;                   // the file without O_DIRECT, for the
+                                      // requests direct I/O rejects
+  BufLatency* ioLatency;              // times the file's own page I/O, or
+                                      // NULL, see setLatency()
+  // The header page is read when the file is opened and kept here;
+  // allocatePage() and disposePage() change only this copy, which
+  // flushHeader() writes back: on close, on BufMgr::flushFile() and when
+  // called.  A crash loses the allocations since.
+  mutable mutex hdrLatch;             // protects header and hdrDirty
+  mutable DBPage header;              // the file's header page
+  mutable bool hdrDirty;              // header differs from page 0
+  // In a FREEBITMAP file the bitmap pages are kept here too, a bit set
+  // for every page in use, the header and bitmap pages among them; the
+  // bits past numPages are clear.  A page is allocated or disposed of by
+  // changing its bit, and the pages of changed bitmaps are written back
+  // with the header.
+  vector<uint64_t> usedMap;           // the bitmaps, one after another
+  mutable vector<bool> mapDirty;      // bitmap differs from its page
+  int freeHint;                       // words of usedMap before are full
+  int diskPages;                      // pages the file has room for; the
+                                      // ones from numPages on are zero
 };
 
 class BufMgr;
@@ -103,23 +185,17 @@ class DB {
   DB();                                 // initialize open file table
   ~DB();                                // clean up any remaining open files
 
-  const Status createFile(const string & fileName) ;  // create a new file
+  const Status createFile(const string & fileName,
+			  const FileFormat format = FREELIST);  // create a new file
   const Status destroyFile(const string & fileName) ; // destroy a file, 
                                                            // release all space
-  const Status openFile(const string & fileName, File* & file);  // open a file
+  const Status openFile(const string & fileName, File* & file,
+			const bool direct = false);  // open a file
   const Status closeFile(File* file);         // close a file
 
  private:
   OpenFileHashTbl   openFiles;    // list of open files
+  int               numIds;       // number of file ids handed out so far
 };
 
-
-// structure of DB (header) page
-
-typedef struct {
-  int nextFree;                         // page # of next page on free list
-  int firstPage;                        // page # of first page in file
-  int numPages;                         // total # of pages in file
-} DBPage;
-
 #endif
@@ -0,0 +1,332 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include "ioEngine.h"
+#include "bufMetrics.h"
+
+
+atomic<bool> IOEngine::rejectDirect(false);
+
+IOEngine* IOEngine::create(const int depth, const bool threads)
+{
+  if (!threads) {
+    UringEngine* uring = UringEngine::create(depth);
+    if (uring)
+      return uring;
+  }
+  return new ThreadEngine();
+}
+
+void IOEngine::submit(IORequest* const reqs[], const int n)
+{
+  for (int i = 0; i < n; i++)
+    if (reqs[i]->latency)
+      reqs[i]->started = reqs[i]->latency->start();
+  if (!rejectDirect.load(memory_order_relaxed)) {
+    start(reqs, n);
+    return;
+  }
+  vector<IORequest*> rest;
+  for (int i = 0; i < n; i++)
+    if (reqs[i]->fallbackFd >= 0) {
+      {
+	lock_guard<mutex> guard(latch);
+	inflight++;
+      }
+      reqs[i]->result = -EINVAL;
+      completed(reqs[i]);
+    } else
+      rest.push_back(reqs[i]);
+  if (!rest.empty())
+    start(&rest[0], rest.size());
+}
+
+void IOEngine::completed(IORequest* req)
+{
+  if (req->result == -EINVAL && req->fallbackFd >= 0) {
+    ssize_t nbytes = req->write
+      ? pwritev(req->fallbackFd, req->iov, req->iovcnt, req->offset)
+      : preadv(req->fallbackFd, req->iov, req->iovcnt, req->offset);
+    req->result = nbytes < 0 ? -errno : nbytes;
+  }
+  if (req->latency)
+    req->latency->record(req->write ? FILEWRITE : FILEREAD, req->started);
+  if (req->done)
+    req->done(req);
+  lock_guard<mutex> guard(latch);
+  inflight--;
+  progress.notify_all();
+}
+
+void IOEngine::drain()
+{
+  unique_lock<mutex> lock(latch);
+  while (inflight > 0)
+    progress.wait(lock);
+}
+
+
+void IOBatch::add(IORequest& req)
+{
+  req.done = finished;
+  req.arg = this;
+  lock_guard<mutex> guard(latch);
+  pending++;
+}
+
+void IOBatch::finished(IORequest* req)
+{
+  IOBatch* batch = (IOBatch*) req->arg;
+  lock_guard<mutex> guard(batch->latch);
+  if (--batch->pending == 0)
+    batch->allDone.notify_all();
+}
+
+void IOBatch::wait()
+{
+  unique_lock<mutex> lock(latch);
+  while (pending > 0)
+    allDone.wait(lock);
+}
+
+
+UringEngine::UringEngine()
+  : ringFd(-1), sqRing(MAP_FAILED), sqRingBytes(0), cqRing(MAP_FAILED),
+    cqRingBytes(0), sqes((struct io_uring_sqe*) MAP_FAILED), sqesBytes(0)
+{
+}
+
+UringEngine* UringEngine::create(const int depth)
+{
+  UringEngine* uring = new UringEngine();
+  if (!uring->setup(depth)) {
+    delete uring;
+    return NULL;
+  }
+  uring->reaper = thread(&UringEngine::reapLoop, uring);
+  return uring;
+}
+
+// io_uring_setup() and mapping the rings, as liburing does it
+bool UringEngine::setup(const int depth)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof params);
+  ringFd = syscall(__NR_io_uring_setup, max(depth, 1), &params);
+  if (ringFd < 0)
+    return false;
+  sqEntries = params.sq_entries;
+  cqEntries = params.cq_entries;
+
+  sqRingBytes = params.sq_off.array + sqEntries * sizeof(unsigned);
+  cqRingBytes = params.cq_off.cqes + cqEntries * sizeof(struct io_uring_cqe);
+  bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single)
+    sqRingBytes = cqRingBytes = max(sqRingBytes, cqRingBytes);
+  sqRing = mmap(NULL, sqRingBytes, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED)
+    return false;
+  if (single)
+    cqRing = sqRing;
+  else {
+    cqRing = mmap(NULL, cqRingBytes, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED)
+      return false;
+  }
+  sqesBytes = sqEntries * sizeof(struct io_uring_sqe);
+  sqes = (struct io_uring_sqe*) mmap(NULL, sqesBytes, PROT_READ | PROT_WRITE,
+				     MAP_SHARED | MAP_POPULATE, ringFd,
+				     IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    return false;
+
+  char* sq = (char*) sqRing;
+  char* cq = (char*) cqRing;
+  sqHead = (unsigned*) (sq + params.sq_off.head);
+  sqTail = (unsigned*) (sq + params.sq_off.tail);
+  sqMask = *(unsigned*) (sq + params.sq_off.ring_mask);
+  sqArray = (unsigned*) (sq + params.sq_off.array);
+  cqHead = (unsigned*) (cq + params.cq_off.head);
+  cqTail = (unsigned*) (cq + params.cq_off.tail);
+  cqMask = *(unsigned*) (cq + params.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+  return true;
+}
+
+UringEngine::~UringEngine()
+{
+  if (reaper.joinable()) {
+    drain();
+    //a no-op without a request stops the reaper
+    {
+      lock_guard<mutex> guard(submitLatch);
+      unsigned tail = *sqTail;
+      unsigned idx = tail & sqMask;
+      memset(&sqes[idx], 0, sizeof sqes[idx]);
+      sqes[idx].opcode = IORING_OP_NOP;
+      sqes[idx].user_data = 0;
+      sqArray[idx] = idx;
+      __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+      enter(1);
+    }
+    reaper.join();
+  }
+  if (sqes != MAP_FAILED)
+    munmap(sqes, sqesBytes);
+  if (cqRing != MAP_FAILED && cqRing != sqRing)
+    munmap(cqRing, cqRingBytes);
+  if (sqRing != MAP_FAILED)
+    munmap(sqRing, sqRingBytes);
+  if (ringFd >= 0)
+    close(ringFd);
+}
+
+void UringEngine::start(IORequest* const reqs[], const int n)
+{
+  lock_guard<mutex> guard(submitLatch);
+  int i = 0;
+  while (i < n) {
+    //never more in flight than the completion ring holds
+    unique_lock<mutex> lock(latch);
+    while (inflight >= (int) cqEntries)
+      progress.wait(lock);
+    unsigned count = min((unsigned) (n - i),
+			 min(sqEntries, cqEntries - (unsigned) inflight));
+    inflight += count;
+    //the kernel consumes every entry in enter(), so the ring is empty
+    unsigned tail = *sqTail;
+    for (unsigned k = 0; k < count; k++) {
+      IORequest* req = reqs[i + k];
+      unsigned idx = (tail + k) & sqMask;
+      struct io_uring_sqe* sqe = &sqes[idx];
+      memset(sqe, 0, sizeof *sqe);
+      sqe->opcode = req->write ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->fd = req->fd;
+      sqe->off = req->offset;
+      sqe->addr = (uintptr_t) req->iov;
+      sqe->len = req->iovcnt;
+      sqe->user_data = (uintptr_t) req;
+      sqArray[idx] = idx;
+    }
+    __atomic_store_n(sqTail, tail + count, __ATOMIC_RELEASE);
+    lock.unlock();
+    enter(count);
+    i += count;
+  }
+}
+
+void UringEngine::enter(unsigned count)
+{
+  while (count > 0) {
+    int ret = syscall(__NR_io_uring_enter, ringFd, count, 0, 0, NULL, 0);
+    if (ret > 0) {
+      count -= ret;
+      continue;
+    }
+    if (ret == 0 || errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+      //out of resources for the moment; let completions free some
+      this_thread::yield();
+      continue;
+    }
+    //the kernel refuses the entries: take them back and fail them
+    int err = errno;
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail;
+    __atomic_store_n(sqTail, head, __ATOMIC_RELEASE);
+    for (; head != tail; head++) {
+      IORequest* req = (IORequest*) sqes[sqArray[head & sqMask]].user_data;
+      if (req) {
+	req->result = -err;
+	completed(req);
+      }
+    }
+    return;
+  }
+}
+
+void UringEngine::reapLoop()
+{
+  while (1) {
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS,
+	      NULL, 0);
+      continue;
+    }
+    //submit() read the requests holding latch; taking it here orders
+    //that before their completion in terms the language (and the thread
+    //sanitizer) knows, not only through the kernel's rings
+    {
+      lock_guard<mutex> guard(latch);
+    }
+    for (; head != tail; head++) {
+      struct io_uring_cqe* cqe = &cqes[head & cqMask];
+      IORequest* req = (IORequest*) cqe->user_data;
+      int res = cqe->res;
+      //hand the slot back before calling anybody
+      __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+      if (!req)
+	return;  // the destructor's no-op
+      req->result = res;
+      completed(req);
+    }
+  }
+}
+
+
+ThreadEngine::ThreadEngine(const int threads) : stop(false)
+{
+  for (int t = 0; t < max(threads, 1); t++)
+    workers.push_back(thread(&ThreadEngine::workLoop, this));
+}
+
+ThreadEngine::~ThreadEngine()
+{
+  drain();
+  {
+    lock_guard<mutex> guard(latch);
+    stop = true;
+  }
+  work.notify_all();
+  for (size_t t = 0; t < workers.size(); t++)
+    workers[t].join();
+}
+
+void ThreadEngine::start(IORequest* const reqs[], const int n)
+{
+  lock_guard<mutex> guard(latch);
+  inflight += n;
+  for (int i = 0; i < n; i++)
+    queue.push_back(reqs[i]);
+  if (n == 1)
+    work.notify_one();
+  else
+    work.notify_all();
+}
+
+void ThreadEngine::workLoop()
+{
+  unique_lock<mutex> lock(latch);
+  while (1) {
+    while (queue.empty() && !stop)
+      work.wait(lock);
+    if (queue.empty())
+      return;
+    IORequest* req = queue.front();
+    queue.pop_front();
+    lock.unlock();
+    ssize_t nbytes = req->write
+      ? pwritev(req->fd, req->iov, req->iovcnt, req->offset)
+      : preadv(req->fd, req->iov, req->iovcnt, req->offset);
+    req->result = nbytes < 0 ? -errno : nbytes;
+    completed(req);
+    lock.lock();
+  }
+}
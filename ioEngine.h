@@ -0,0 +1,170 @@
+#ifndef IOENGINE_H
+#define IOENGINE_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include "page.h"
+#include "db.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+class BufLatency;
+
+// requests an io_uring engine keeps in flight at most
+const int IODEPTH = 128;
+
+// threads of the engine used where io_uring is not available
+const int IOTHREADS = 4;
+
+// pages in one IORequest at most
+const int IOMAXPAGES = 256;
+
+// One positioned, vectored read or write, see IOEngine.  File::ioRequest
+// fills in what to transfer; the submitter sets done (and arg).
+struct IORequest
+{
+  int     fd;
+  int     fallbackFd;  // to do the request on if fd fails it with EINVAL,
+                       // or -1: the buffered descriptor of a direct file
+  bool    write;
+  off_t   offset;
+  struct iovec* iov;   // the buffers, iovcnt of them
+  int     iovcnt;
+  ssize_t result;      // set on completion: bytes transferred or -errno
+  void  (*done)(IORequest* req);  // called on completion
+  void*   arg;         // for done
+  BufLatency* latency; // times the request as FILEREAD or FILEWRITE, or NULL
+  uint64_t started;    // when it was submitted, for latency
+
+  IORequest() : fd(-1), fallbackFd(-1), write(false), offset(0), iov(NULL), iovcnt(0),
+		result(0), done(NULL), arg(NULL), latency(NULL), started(0) {}
+};
+
+// Asynchronous page I/O: requests handed to submit() are carried out in
+// the background, many at a time, and complete in any order.  On
+// completion the engine sets the request's result and calls its done
+// function on one of its own threads.  done must not block for long or
+// submit more requests; the request is the submitter's again once done
+// is called.
+//
+// create() sets up an io_uring and falls back to a pool of IOTHREADS
+// threads doing preadv/pwritev where the kernel does not have io_uring
+// or does not allow it.  All methods may be called concurrently.
+//
+// A request that fails with EINVAL and has a fallbackFd is done again
+// on that descriptor, with preadv/pwritev before done is called: a
+// device whose blocks are larger than a page rejects direct I/O of
+// single pages.  A request with a latency is timed from submit() until
+// then, retry included.
+class IOEngine
+{
+protected:
+  mutex   latch;
+  condition_variable progress;  // signalled when requests complete
+  int     inflight;         // submitted and not completed yet
+
+  void completed(IORequest* req);  // a request finished, tell its owner
+  // start the n requests in reqs
+  virtual void start(IORequest* const reqs[], const int n) = 0;
+
+public:
+  IOEngine() : inflight(0) {}
+  // requests still in flight are waited for
+  virtual ~IOEngine() {}
+
+  // an io_uring engine with depth entries unless threads is set or
+  // io_uring is not available, else a thread pool
+  static IOEngine* create(const int depth = IODEPTH,
+			  const bool threads = false);
+
+  virtual const char* name() const = 0;
+  // start the n requests in reqs
+  void submit(IORequest* const reqs[], const int n);
+  // wait until no request is in flight
+  void drain();
+
+  // for testing: requests with a fallbackFd fail with EINVAL without
+  // being started, as if the device rejected them
+  static atomic<bool> rejectDirect;
+};
+
+
+// Waits for a set of requests to complete: add() each request before it
+// is submitted, then wait().
+class IOBatch
+{
+private:
+  mutex   latch;
+  condition_variable allDone;
+  int     pending;
+
+  static void finished(IORequest* req);
+
+public:
+  IOBatch() : pending(0) {}
+
+  void add(IORequest& req);  // sets req's done and arg
+  void wait();
+};
+
+
+// io_uring with the submission and completion rings mapped directly;
+// one thread reaps the completions
+class UringEngine : public IOEngine
+{
+private:
+  int     ringFd;
+  void*   sqRing;  size_t sqRingBytes;
+  void*   cqRing;  size_t cqRingBytes;
+  struct io_uring_sqe* sqes;  size_t sqesBytes;
+  unsigned sqEntries, cqEntries;
+  // ring indices shared with the kernel, read and written atomically
+  unsigned* sqTail;  unsigned sqMask;  unsigned* sqArray;
+  unsigned* cqHead;  unsigned* cqTail;  unsigned cqMask;
+  struct io_uring_cqe* cqes;
+  unsigned* sqHead;
+  mutex   submitLatch;        // one submitter at a time
+  thread  reaper;
+
+  UringEngine();
+  bool setup(const int depth);
+  // hand the count newest entries of the submission ring to the kernel
+  void enter(unsigned count);
+  void reapLoop();
+
+public:
+  // NULL if the kernel has no io_uring for us
+  static UringEngine* create(const int depth);
+  ~UringEngine();
+
+  const char* name() const { return "io_uring"; }
+  void start(IORequest* const reqs[], const int n);
+};
+
+
+// preadv/pwritev on a pool of threads
+class ThreadEngine : public IOEngine
+{
+private:
+  deque<IORequest*> queue;    // protected by latch
+  condition_variable work;
+  bool    stop;
+  vector<thread> workers;
+
+  void workLoop();
+
+public:
+  ThreadEngine(const int threads = IOTHREADS);
+  ~ThreadEngine();
+
+  const char* name() const { return "threads"; }
+  void start(IORequest* const reqs[], const int n);
+};
+
+#endif
@@ -0,0 +1,207 @@
+// Plays a trace recorded with BufMgr::startTrace() back through BufMgr,
+// once for every pool size and replacement policy given, and prints for
+// each run the hit ratio, the page reads and writes, and the time per
+// call.
+//
+// The files of the trace are stood in for by files named replay.0,
+// replay.1, ... with as many pages as the trace uses of them, made anew
+// for each run.  allocPage() calls are played as readPage() of the page
+// they allocated.  Calls failing in a run, as readPage() may in a pool
+// smaller than the one traced, are counted and skipped.
+//
+// usage: replay traceFile [frames,... [policy,...]]
+//
+// The output is tab separated, a header line and then one line per run:
+//   policy  frames  calls  hit_ratio  diskreads  diskwrites  failed  ns_per_call
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include "page.h"
+#include "buf.h"
+#include "bufPolicy.h"
+#include "bufTrace.h"
+
+BufMgr*     bufMgr;
+
+// a call of the trace, with its file numbered in order of appearance
+struct Call
+{
+  TraceOp op;
+  bool dirty;
+  int file;
+  int pageNo;
+};
+
+static bool load(const char* path, vector<Call>& calls, vector<int>& size)
+{
+  TraceReader reader;
+  Status status = reader.open(path);
+  if (status != OK) {
+    Error().print(status);
+    return false;
+  }
+  map<string, int> fileOf;  // by name
+  map<int, int> fileOfId;   // by file id, as named last
+  TraceRecord rec;
+  string name;
+  while (reader.next(rec, name)) {
+    if (rec.op == TRACENAME) {
+      map<string, int>::iterator it = fileOf.find(name);
+      if (it == fileOf.end()) {
+	it = fileOf.insert(make_pair(name, (int) size.size())).first;
+	size.push_back(0);
+      }
+      fileOfId[rec.file] = it->second;
+      continue;
+    }
+    map<int, int>::iterator it = fileOfId.find(rec.file);
+    if (it == fileOfId.end() || rec.op > TRACEFLUSH) {
+      cerr << "trace " << path << " is damaged" << endl;
+      return false;
+    }
+    Call call = { (TraceOp) rec.op, (rec.flags & TRACEDIRTY) != 0, it->second,
+		  rec.pageNo };
+    calls.push_back(call);
+    size[call.file] = max(size[call.file], call.pageNo);
+  }
+  return true;
+}
+
+static bool makeFiles(DB& db, const vector<int>& size, vector<File*>& files)
+{
+  files.resize(size.size());
+  for (size_t f = 0; f < size.size(); f++) {
+    char name[32];
+    sprintf(name, "replay.%d", (int) f);
+    if (access(name, F_OK) == 0)
+      (void)db.destroyFile(name);
+    Status status;
+    if ((status = db.createFile(name)) != OK ||
+	(status = db.openFile(name, files[f])) != OK) {
+      Error().print(status);
+      return false;
+    }
+    for (int p = 0; p < size[f]; p++) {
+      int pageNo;
+      if ((status = files[f]->allocatePage(pageNo)) != OK) {
+	Error().print(status);
+	return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void removeFiles(DB& db, vector<File*>& files)
+{
+  for (size_t f = 0; f < files.size(); f++) {
+    char name[32];
+    sprintf(name, "replay.%d", (int) f);
+    db.closeFile(files[f]);
+    db.destroyFile(name);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  vector<int> frames;
+  vector<ReplPolicy> policies;
+  bool ok = argc >= 2 && argc <= 4;
+  if (ok && argc > 2) {
+    istringstream in(argv[2]);
+    string item;
+    while (getline(in, item, ','))
+      if (atoi(item.c_str()) > 0)
+	frames.push_back(atoi(item.c_str()));
+      else
+	ok = false;
+  }
+  if (ok && argc > 3) {
+    istringstream in(argv[3]);
+    string item;
+    while (getline(in, item, ',')) {
+      int k = 0;
+      while (k <= CLOCKPRO && item != BufPolicy::name((ReplPolicy) k))
+	k++;
+      ok = ok && k <= CLOCKPRO;
+      policies.push_back((ReplPolicy) k);
+    }
+  }
+  if (!ok) {
+    cerr << "usage: replay traceFile [frames,... [policy,...]]" << endl;
+    return 1;
+  }
+  if (frames.empty()) {
+    frames.push_back(100);
+    frames.push_back(1000);
+  }
+  if (policies.empty())
+    for (int k = 0; k <= CLOCKPRO; k++)
+      policies.push_back((ReplPolicy) k);
+
+  vector<Call> calls;
+  vector<int> size;
+  if (!load(argv[1], calls, size))
+    return 1;
+
+  DB db;
+  cout << "# trace=" << argv[1] << " calls=" << calls.size() << " files="
+       << size.size() << endl;
+  cout << "policy\tframes\tcalls\thit_ratio\tdiskreads\tdiskwrites\tfailed"
+       << "\tns_per_call" << endl;
+  for (size_t p = 0; p < policies.size(); p++)
+    for (size_t s = 0; s < frames.size(); s++) {
+      bufMgr = new BufMgr(frames[s], BUFPARTITIONS, policies[p]);
+      vector<File*> files;
+      if (!makeFiles(db, size, files))
+	return 1;
+      long failed = 0;
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      for (size_t n = 0; n < calls.size(); n++) {
+	const Call& call = calls[n];
+	File* file = files[call.file];
+	Page* page;
+	Status status = OK;
+	switch (call.op) {
+	case TRACEREAD:
+	case TRACEALLOC:
+	  status = bufMgr->readPage(file, call.pageNo, page);
+	  break;
+	case TRACEUNPIN:
+	  status = bufMgr->unPinPage(file, call.pageNo, call.dirty);
+	  break;
+	case TRACEDISPOSE:
+	  status = bufMgr->disposePage(file, call.pageNo);
+	  break;
+	default:
+	  status = bufMgr->flushFile(file);
+	}
+	failed += status != OK;
+      }
+      double ns = chrono::duration<double, nano>(chrono::steady_clock::now()
+						 - start).count();
+      BufMetrics::Snapshot snap = bufMgr->getMetrics().snapshot();
+      uint64_t hits = snap[0].count[HITS];
+      uint64_t misses = snap[0].count[MISSES];
+      const BufStats& stats = bufMgr->getBufStats();
+      printf("%s\t%d\t%lu\t%.4f\t%d\t%d\t%ld\t%.0f\n",
+	     BufPolicy::name(policies[p]), frames[s], (unsigned long) calls.size(),
+	     hits + misses ? (double) hits / (hits + misses) : 0.0,
+	     (int) stats.diskreads, (int) stats.diskwrites, failed,
+	     calls.empty() ? 0.0 : ns / calls.size());
+      fflush(stdout);
+      //pages a failed call left pinned keep the files from being flushed
+      //on close; the buffer manager writes them back as it goes away
+      delete bufMgr;
+      bufMgr = NULL;
+      removeFiles(db, files);
+    }
+  return 0;
+}
@@ -1,11 +1,19 @@
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
 #include "page.h"
 #include "buf.h"
+#include "bufPolicy.h"
+#include "ioEngine.h"
+#include "bufTrace.h"
 
 
 #define CALL(c)    { Status s; \
@@ -28,6 +36,109 @@
 
 BufMgr*     bufMgr;
 
+// the row of a metrics snapshot for a file, or NULL
+static const BufMetrics::Row* metricsOf(const BufMetrics::Snapshot& snap,
+					const char* name)
+{
+  for (size_t r = 1; r < snap.size(); r++)
+    if (snap[r].name == name)
+      return &snap[r];
+  return NULL;
+}
+
+// reads random pages of the three test files and checks their contents;
+// run by several threads at once.  Sets failed on the first mismatch.
+static void concurrentReader(File* files[], int pages[], int seed,
+			     int iters, bool* failed)
+{
+  unsigned int state = seed;
+  char cmp[PAGESIZE];
+  for (int n = 0; n < iters && !*failed; n++) {
+    state = state * 1103515245 + 12345;
+    int f = (state >> 16) % 3;
+    int pageno = 1 + (state >> 8) % pages[f];
+    Page* page;
+    if (bufMgr->readPage(files[f], pageno, page) != OK) {
+      *failed = true;
+      break;
+    }
+    sprintf(cmp, "test.%d Page %d %7.1f", f + 1, pageno, (float)pageno);
+    if (memcmp(page, cmp, strlen(cmp)) != 0)
+      *failed = true;
+    if (bufMgr->unPinPage(files[f], pageno, false) != OK)
+      *failed = true;
+  }
+}
+
+// reads pages 1 to pages of a file in order through a ring, checking
+// their contents; sets done when finished, failed on a mismatch
+static void ringScan(File* file, int pages, atomic<bool>* done, bool* failed)
+{
+  BufRing ring;
+  char cmp[PAGESIZE];
+  for (int pageno = 1; pageno <= pages && !*failed; pageno++) {
+    Page* page;
+    if (bufMgr->readPage(file, pageno, page, &ring) != OK) {
+      *failed = true;
+      break;
+    }
+    sprintf(cmp, "test.2 Page %d %7.1f", pageno, (float)pageno);
+    if (memcmp(page, cmp, strlen(cmp)) != 0)
+      *failed = true;
+    if (bufMgr->unPinPage(file, pageno, false) != OK)
+      *failed = true;
+  }
+  *done = true;
+}
+
+// reads pages 1 to pages of a file in turn, rounds times, while the
+// calls are traced; sets failed on an error
+static void tracedReader(File* file, int pages, int rounds, bool* failed)
+{
+  for (int n = 0; n < pages * rounds && !*failed; n++) {
+    Page* page;
+    if (bufMgr->readPage(file, 1 + n % pages, page) != OK ||
+	bufMgr->unPinPage(file, 1 + n % pages, false) != OK)
+      *failed = true;
+  }
+}
+
+// reads pages 1 to pages of a file with one readPages(); sets failed on
+// an error
+static void batchReader(File* file, int pages, bool* failed)
+{
+  vector<int> pageNos(pages);
+  vector<Page*> ptrs(pages);
+  for (int i = 0; i < pages; i++)
+    pageNos[i] = i + 1;
+  if (bufMgr->readPages(file, &pageNos[0], &ptrs[0], pages) != OK ||
+      bufMgr->unPinPages(file, &pageNos[0], pages, false) != OK)
+    *failed = true;
+}
+
+// reads random pages of test.1 and checks their contents until stop is
+// set, while the pool is resized; sets failed on a mismatch or an error
+static void resizeReader(File* file, int pages, int seed, atomic<bool>* stop,
+			 bool* failed)
+{
+  unsigned int state = seed;
+  char cmp[PAGESIZE];
+  while (!*stop && !*failed) {
+    state = state * 1103515245 + 12345;
+    int pageno = 1 + (state >> 8) % pages;
+    Page* page;
+    if (bufMgr->readPage(file, pageno, page) != OK) {
+      *failed = true;
+      break;
+    }
+    sprintf(cmp, "test.1 Page %d %7.1f", pageno, (float)pageno);
+    if (memcmp(page, cmp, strlen(cmp)) != 0)
+      *failed = true;
+    if (bufMgr->unPinPage(file, pageno, false) != OK)
+      *failed = true;
+  }
+}
+
 int main()
 {
 
@@ -197,6 +308,26 @@ int main()
 
     cout << "Test passed" <<endl<<endl;
 
+    cout << "\nReading all three files from 8 threads at once...\n";
+    cout << "Expected Result: ";
+    cout << "Every page read matches its page number.\n\n";
+
+    {
+      File* files[3] = { file1, file2, file3 };
+      int pages[3] = { num, num/3, num/3 };
+      bool failed[8] = { false };
+      vector<thread> readers;
+      for (i = 0; i < 8; i++)
+	readers.push_back(thread(concurrentReader, files, pages, i + 1,
+				 2000, &failed[i]));
+      for (i = 0; i < 8; i++) {
+	readers[i].join();
+	ASSERT(!failed[i]);
+      }
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
    
     cout << "\nTesting error condition...\n\n";
     cout << "Expected Result: Error statments followed by the \"Test passed\" statement."<<endl;
@@ -257,16 +388,28 @@ int main()
     FAIL(status = bufMgr->flushFile(file1));
     error.print(status);
 
+    cout << "closing it fails the same way and leaves it open" << endl;
+    FAIL(status = db.closeFile(file1));
+    error.print(status);
+    CALL(bufMgr->readPage(file1, 1, page));
+    CALL(bufMgr->unPinPage(file1, 1, false));
+
     cout << "Test passed"<<endl<<endl;
 
     for (i = 1; i < num; i++) 
     CALL(bufMgr->unPinPage(file1, i, true));
     CALL(bufMgr->flushFile(file1));
+    int lastId = file4->getId();
     CALL(db.closeFile(file1));
     CALL(db.closeFile(file2));
     CALL(db.closeFile(file3));
     CALL(db.closeFile(file4));
 
+    // the ids of closed files are not given out again
+    CALL(db.openFile("test.1", file1));
+    ASSERT(file1->getId() == lastId + 1);
+    CALL(db.closeFile(file1));
+
     CALL(db.destroyFile("test.1"));
     CALL(db.destroyFile("test.2"));
     CALL(db.destroyFile("test.3"));
@@ -274,6 +417,1071 @@ int main()
 
     delete bufMgr;
 
+    cout << "\nRunning a small pool with each replacement policy and pool mapping...\n";
+    cout << "Expected Result: ";
+    cout << "Pages read back correctly, an error once all frames are pinned.\n\n";
+
+    ReplPolicy policies[] = { CLOCK, LRUK, TWOQ, ARC, CLOCKPRO };
+    int poolFlags[] = { 0, POOLLAZY, POOLHUGE, POOLHUGE | POOLLAZY, POOLHUGETLB };
+    for (int p = 0; p < 5; p++) {
+      const int frames = 10;
+      cout << BufPolicy::name(policies[p]) << endl;
+      bufMgr = new BufMgr(frames, BUFPARTITIONS, policies[p], poolFlags[p]);
+      ASSERT((unsigned long) bufMgr->bufPool % 4096 == 0);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      for (i = 0; i < 3 * frames; i++) {
+	CALL(bufMgr->allocPage(file1, pageno, page));
+	sprintf((char*)page, "test.1 Page %d %7.1f", pageno, (float)pageno);
+	CALL(bufMgr->unPinPage(file1, pageno, true));
+      }
+      // a few hot pages, read between the pages of repeated scans
+      for (int k = 0; k < 6 * frames; k++) {
+	pageno = k % 2 ? 1 + (k / 2) % 3 : 1 + (k * 7) % (3 * frames);
+	CALL(bufMgr->readPage(file1, pageno, page));
+	sprintf((char*)&cmp, "test.1 Page %d %7.1f", pageno, (float)pageno);
+	ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+	CALL(bufMgr->unPinPage(file1, pageno, false));
+      }
+      for (i = 1; i <= frames; i++)
+	CALL(bufMgr->readPage(file1, i, page));
+      FAIL(status = bufMgr->readPage(file1, frames + 1, page));
+      for (i = 1; i <= frames; i++)
+	CALL(bufMgr->unPinPage(file1, i, false));
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nCleaning dirty pages in the background...\n";
+    cout << "Expected Result: ";
+    cout << "The writer writes the pages back, replacing them needs no writes.\n\n";
+
+    {
+      const int frames = 10;
+      bufMgr = new BufMgr(frames);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      for (i = 0; i < frames; i++) {
+	CALL(bufMgr->allocPage(file1, pageno, page));
+	sprintf((char*)page, "test.1 Page %d %7.1f", pageno, (float)pageno);
+	CALL(bufMgr->unPinPage(file1, pageno, true));
+      }
+      bufMgr->startWriter(frames);
+      for (i = 0; i < 500 && bufMgr->getBufStats().diskwrites < frames; i++)
+	this_thread::sleep_for(chrono::milliseconds(WRITERDELAY));
+      bufMgr->stopWriter();
+      ASSERT(bufMgr->getBufStats().diskwrites == frames);
+      for (i = 0; i < frames; i++) {
+	CALL(bufMgr->allocPage(file1, pageno, page));
+	CALL(bufMgr->unPinPage(file1, pageno, false));
+      }
+      ASSERT(bufMgr->getBufStats().diskwrites == frames);
+      for (i = 1; i <= frames; i++) {
+	CALL(bufMgr->readPage(file1, i, page));
+	sprintf((char*)&cmp, "test.1 Page %d %7.1f", i, (float)i);
+	ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+	CALL(bufMgr->unPinPage(file1, i, false));
+      }
+      CALL(db.closeFile(file1));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nPrefetching pages...\n";
+    cout << "Expected Result: ";
+    cout << "Prefetched pages read correctly, each one read from disk once.\n\n";
+
+    {
+      const int frames = 10;
+      int pageNos[frames];
+      bufMgr = new BufMgr(frames);
+      CALL(db.openFile("test.1", file1));
+      for (i = 0; i < frames; i++)
+	pageNos[i] = frames - i;
+      CALL(bufMgr->prefetch(file1, pageNos, frames));
+      // reading right away waits for the reads under way
+      for (i = 1; i <= frames; i++) {
+	CALL(bufMgr->readPage(file1, i, page));
+	sprintf((char*)&cmp, "test.1 Page %d %7.1f", i, (float)i);
+	ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+	CALL(bufMgr->unPinPage(file1, i, false));
+      }
+      ASSERT(bufMgr->getBufStats().diskreads == frames);
+      ASSERT(bufMgr->getBufStats().accesses == frames);
+      // pages in the pool already are not read again
+      CALL(bufMgr->prefetch(file1, pageNos, frames));
+      ASSERT(bufMgr->getBufStats().diskreads == frames);
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nReading and unpinning pages in batches...\n";
+    cout << "Expected Result: ";
+    cout << "Pages match, each missing page read once, nothing left pinned.\n\n";
+
+    {
+      const int frames = 20, n = 12;
+      // hits 1-3, misses 10-15 and 18, page 12 twice, page 2 twice
+      int pageNos[n] = { 12, 1, 10, 2, 11, 18, 13, 3, 12, 14, 2, 15 };
+      Page* pages[n];
+      bufMgr = new BufMgr(frames);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      for (i = 0; i < 2 * frames; i++) {
+	CALL(bufMgr->allocPage(file1, pageno, page));
+	sprintf((char*)page, "test.1 Page %d %7.1f", pageno, (float)pageno);
+	CALL(bufMgr->unPinPage(file1, pageno, true));
+      }
+      CALL(bufMgr->flushFile(file1));
+      for (i = 1; i <= 3; i++) {
+	CALL(bufMgr->readPage(file1, i, page));
+	CALL(bufMgr->unPinPage(file1, i, false));
+      }
+      bufMgr->clearBufStats();
+      CALL(bufMgr->readPages(file1, pageNos, pages, n));
+      for (i = 0; i < n; i++) {
+	sprintf((char*)&cmp, "test.1 Page %d %7.1f", pageNos[i], (float)pageNos[i]);
+	ASSERT(memcmp(pages[i], &cmp, strlen((char*)&cmp)) == 0);
+      }
+      ASSERT(pages[0] == pages[8] && pages[3] == pages[10]);
+      ASSERT(bufMgr->getBufStats().diskreads == 7);
+      ASSERT(bufMgr->getBufStats().accesses == n);
+      CALL(bufMgr->unPinPages(file1, pageNos, n, false));
+      FAIL(bufMgr->unPinPage(file1, 12, false));
+      // more pages than frames: fails without pinning any
+      int all[2 * frames];
+      Page* allPages[2 * frames];
+      for (i = 0; i < 2 * frames; i++)
+	all[i] = i + 1;
+      FAIL(bufMgr->readPages(file1, all, allPages, 2 * frames));
+      CALL(bufMgr->flushFile(file1));
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nPinning pages through handles...\n";
+    cout << "Expected Result: ";
+    cout << "Pages match and are unpinned when their handles go away.\n\n";
+
+    {
+      const int frames = 10;
+      bufMgr = new BufMgr(frames);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      for (i = 0; i < 3 * frames; i++) {
+	PageHandle handle;
+	CALL(bufMgr->allocPage(file1, pageno, handle));
+	sprintf((char*)handle.page(), "test.1 Page %d %7.1f", pageno, (float)pageno);
+	handle.markDirty();
+      }
+      {
+	// the whole pool pinned through handles, then handed around
+	vector<PageHandle> handles(frames);
+	for (i = 0; i < frames; i++) {
+	  CALL(bufMgr->readPage(file1, i + 1, handles[i]));
+	  sprintf((char*)&cmp, "test.1 Page %d %7.1f", i + 1, (float)(i + 1));
+	  ASSERT(memcmp(handles[i].page(), &cmp, strlen((char*)&cmp)) == 0);
+	}
+	FAIL(bufMgr->readPage(file1, frames + 1, page));
+	PageHandle moved = move(handles[0]);
+	ASSERT(!handles[0].valid() && moved.valid() && moved.getPageNo() == 1);
+	// reading into a handle releases its old page first
+	CALL(bufMgr->readPage(file1, frames + 1, moved));
+	ASSERT(moved.getPageNo() == frames + 1);
+      }
+      CALL(bufMgr->flushFile(file1));
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nWriting and reading back a file opened for direct I/O...\n";
+    cout << "Expected Result: ";
+    cout << "Pages in order.  Values matching page number, also when the device\n"
+	 << "rejects direct I/O of the pages.\n\n";
+
+    for (int reject = 0; reject < 2; reject++) {
+      const int frames = 10;
+      IOEngine::rejectDirect = reject;
+      bufMgr = new BufMgr(frames);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1, true));
+      cout << (file1->isDirect() ? "direct I/O" : "no direct I/O here, buffered")
+	   << (reject ? ", rejected" : "") << endl;
+      for (i = 0; i < 3 * frames; i++) {
+	CALL(bufMgr->allocPage(file1, pageno, page));
+	sprintf((char*)page, "test.1 Page %d %7.1f", pageno, (float)pageno);
+	CALL(bufMgr->unPinPage(file1, pageno, true));
+      }
+      CALL(bufMgr->flushFile(file1));
+      for (i = 1; i <= 3 * frames; i++) {
+	CALL(bufMgr->readPage(file1, i, page));
+	sprintf((char*)&cmp, "test.1 Page %d %7.1f", i, (float)i);
+	ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+	CALL(bufMgr->unPinPage(file1, i, false));
+      }
+      // the batched reads and prefetch() go through the I/O engine
+      int pageNos[frames];
+      Page* pages[frames];
+      for (i = 0; i < frames; i++)
+	pageNos[i] = 1 + i;
+      CALL(bufMgr->readPages(file1, pageNos, pages, frames));
+      for (i = 0; i < frames; i++) {
+	sprintf((char*)&cmp, "test.1 Page %d %7.1f", 1 + i, (float)(1 + i));
+	ASSERT(memcmp(pages[i], &cmp, strlen((char*)&cmp)) == 0);
+      }
+      CALL(bufMgr->unPinPages(file1, pageNos, frames, false));
+      for (i = 0; i < frames; i++)
+	pageNos[i] = frames + 1 + i;
+      CALL(bufMgr->prefetch(file1, pageNos, frames));
+      for (i = frames + 1; i <= 2 * frames; i++) {
+	CALL(bufMgr->readPage(file1, i, page));
+	sprintf((char*)&cmp, "test.1 Page %d %7.1f", i, (float)i);
+	ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+	CALL(bufMgr->unPinPage(file1, i, false));
+      }
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+      IOEngine::rejectDirect = false;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nWriting and reading pages through the I/O engines...\n";
+    cout << "Expected Result: ";
+    cout << "Every request transfers all its pages, pages read back match.\n\n";
+
+    {
+      const int pages = 64, run = 16;
+      static Page out[pages], in[pages];
+      struct iovec iov[pages];
+      IORequest reqs[pages / run];
+      IORequest* submit[pages / run];
+      // no buffer manager: the file is read and written around it
+      bufMgr = NULL;
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      for (i = 0; i < pages; i++) {
+	CALL(file1->allocatePage(pageno));
+	sprintf((char*)&out[i], "test.1 Page %d %7.1f", pageno, (float)pageno);
+      }
+      for (int threads = 0; threads < 2; threads++) {
+	IOEngine* io = IOEngine::create(IODEPTH, threads);
+	cout << io->name() << endl;
+	for (int write = 1; write >= 0; write--) {
+	  IOBatch batch;
+	  for (i = 0; i < pages; i++) {
+	    iov[i].iov_base = write ? &out[i] : &in[i];
+	    iov[i].iov_len = sizeof(Page);
+	  }
+	  for (int r = 0; r < pages / run; r++) {
+	    CALL(file1->ioRequest(reqs[r], write, 1 + r * run, &iov[r * run], run));
+	    batch.add(reqs[r]);
+	    submit[r] = &reqs[r];
+	  }
+	  io->submit(submit, pages / run);
+	  batch.wait();
+	  for (int r = 0; r < pages / run; r++)
+	    ASSERT(reqs[r].result == (ssize_t) (run * sizeof(Page)));
+	}
+	ASSERT(memcmp(in, out, sizeof out) == 0);
+	memset(in, 0, sizeof in);
+	delete io;
+      }
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nScanning a large file while looking up pages of another...\n";
+    cout << "Expected Result: ";
+    cout << "Every lookup hits, the scan only reads its own pages.\n\n";
+
+    {
+      const int frames = 50, hot = 20, scanned = 200;
+      bufMgr = new BufMgr(frames);
+      CALL(db.createFile("test.1"));
+      CALL(db.createFile("test.2"));
+      CALL(db.openFile("test.1", file1));
+      CALL(db.openFile("test.2", file2));
+      for (i = 0; i < scanned; i++) {
+	CALL(bufMgr->allocPage(file2, pageno, page));
+	sprintf((char*)page, "test.2 Page %d %7.1f", pageno, (float)pageno);
+	CALL(bufMgr->unPinPage(file2, pageno, true));
+	if (i < hot) {
+	  CALL(bufMgr->allocPage(file1, pageno, page));
+	  sprintf((char*)page, "test.1 Page %d %7.1f", pageno, (float)pageno);
+	  CALL(bufMgr->unPinPage(file1, pageno, true));
+	}
+      }
+      CALL(bufMgr->flushFile(file1));
+      CALL(bufMgr->flushFile(file2));
+      for (i = 1; i <= hot; i++) {
+	CALL(bufMgr->readPage(file1, i, page));
+	CALL(bufMgr->unPinPage(file1, i, false));
+      }
+      bufMgr->clearBufStats();
+
+      atomic<bool> done(false);
+      bool failed = false;
+      thread scanner(ringScan, file2, scanned, &done, &failed);
+      int lookups = 0;
+      while (!done || lookups < 1000) {
+	pageno = 1 + random() % hot;
+	CALL(bufMgr->readPage(file1, pageno, page));
+	sprintf((char*)&cmp, "test.1 Page %d %7.1f", pageno, (float)pageno);
+	ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+	CALL(bufMgr->unPinPage(file1, pageno, false));
+	lookups++;
+      }
+      scanner.join();
+      ASSERT(!failed);
+      const BufStats& stats = bufMgr->getBufStats();
+      cout << "lookup hit ratio "
+	   << 1.0 - (double) (stats.diskreads - scanned) / lookups << endl;
+      ASSERT(stats.diskreads == scanned);
+      delete bufMgr;
+
+      // a ring frame the policy has given to another page since is left
+      // to that page: the ring's 2 frames are freed, test.1 pages 16 and
+      // 17 loaded into them, and the scan reads on
+      BufRing ring;
+      bufMgr = new BufMgr(18);
+      for (i = 1; i <= 2; i++) {
+	CALL(bufMgr->readPage(file2, i, page, &ring));
+	CALL(bufMgr->unPinPage(file2, i, false));
+      }
+      for (i = 1; i <= 15; i++)
+	CALL(bufMgr->readPage(file1, i, page));
+      CALL(bufMgr->flushFile(file2));
+      for (i = 16; i <= 17; i++)
+	CALL(bufMgr->readPage(file1, i, page));
+      for (i = 16; i <= 17; i++)
+	CALL(bufMgr->unPinPage(file1, i, false));
+      CALL(bufMgr->readPage(file2, 3, page, &ring));
+      CALL(bufMgr->unPinPage(file2, 3, false));
+      bufMgr->clearBufStats();
+      for (i = 16; i <= 17; i++) {
+	CALL(bufMgr->readPage(file1, i, page));
+	CALL(bufMgr->unPinPage(file1, i, false));
+      }
+      ASSERT(bufMgr->getBufStats().diskreads == 0);
+      for (i = 1; i <= 15; i++)
+	CALL(bufMgr->unPinPage(file1, i, false));
+      CALL(db.closeFile(file1));
+      CALL(db.closeFile(file2));
+      CALL(db.destroyFile("test.1"));
+      CALL(db.destroyFile("test.2"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nCounting accesses per file...\n";
+    cout << "Expected Result: ";
+    cout << "Hits, misses, reads and evictions counted for the right file.\n\n";
+
+    {
+      const int frames = 10;
+      bufMgr = new BufMgr(frames);
+      CALL(db.createFile("test.1"));
+      CALL(db.createFile("test.2"));
+      CALL(db.openFile("test.1", file1));
+      CALL(db.openFile("test.2", file2));
+      for (i = 0; i < frames; i++) {
+	CALL(bufMgr->allocPage(file1, pageno, page));
+	CALL(bufMgr->unPinPage(file1, pageno, true));
+	if (i < frames / 2) {
+	  CALL(bufMgr->allocPage(file2, pageno, page));
+	  CALL(bufMgr->unPinPage(file2, pageno, true));
+	}
+      }
+      CALL(bufMgr->flushFile(file1));
+      CALL(bufMgr->flushFile(file2));
+      bufMgr->clearMetrics();
+
+      // the first pass misses, the second one hits
+      for (int pass = 0; pass < 2; pass++)
+	for (i = 1; i <= frames; i++) {
+	  CALL(bufMgr->readPage(file1, i, page));
+	  CALL(bufMgr->unPinPage(file1, i, false));
+	}
+      // these replace clean pages of test.1
+      for (i = 1; i <= frames / 2; i++) {
+	CALL(bufMgr->readPage(file2, i, page));
+	CALL(bufMgr->unPinPage(file2, i, i == 1));
+      }
+      CALL(bufMgr->flushFile(file2));
+
+      BufMetrics::Snapshot snap = bufMgr->getMetrics().snapshot();
+      const BufMetrics::Row* one = metricsOf(snap, "test.1");
+      const BufMetrics::Row* two = metricsOf(snap, "test.2");
+      ASSERT(one && two);
+      ASSERT(one->count[HITS] == frames && one->count[MISSES] == frames);
+      ASSERT(one->count[READS] == frames && one->count[WRITES] == 0);
+      ASSERT(one->count[EVICTCLEAN] == frames / 2);
+      ASSERT(one->count[EVICTDIRTY] == 0);
+      ASSERT(two->count[HITS] == 0 && two->count[MISSES] == frames / 2);
+      ASSERT(two->count[READS] == frames / 2);
+      ASSERT(two->count[WRITES] == 1 && two->count[FLUSHWRITES] == 1);
+      ASSERT(snap[0].count[READS] == frames + frames / 2);
+
+      // the counts of a closed file stay under its name
+      CALL(db.closeFile(file1));
+      snap = bufMgr->getMetrics().snapshot();
+      one = metricsOf(snap, "test.1");
+      ASSERT(one && one->count[HITS] == frames && one->count[MISSES] == frames);
+      ostringstream json;
+      bufMgr->getMetrics().dump(json, true);
+      ASSERT(json.str().find("\"test.1\": {\"hits\": 10") != string::npos);
+      bufMgr->getMetrics().dump(cout);
+
+      CALL(db.closeFile(file2));
+      CALL(db.destroyFile("test.1"));
+      CALL(db.destroyFile("test.2"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nTiming reads and allocations...\n";
+    cout << "Expected Result: ";
+    cout << "Every timed call recorded once, nothing while timing is off.\n\n";
+
+    {
+      // every latency falls in a bucket no wider than a sixteenth of it
+      for (uint64_t ns = 1; ns < ((uint64_t) 1 << 38); ns += 1 + ns / 7) {
+	int b = LatencyHistogram::bucketOf(ns);
+	ASSERT(LatencyHistogram::highest(b) >= ns);
+	ASSERT(b == 0 || LatencyHistogram::highest(b - 1) < ns);
+	ASSERT(LatencyHistogram::highest(b) - ns <= ns / 16);
+      }
+
+      const int frames = 10;
+      bufMgr = new BufMgr(frames);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      for (i = 0; i < frames; i++) {
+	CALL(bufMgr->allocPage(file1, pageno, page));
+	CALL(bufMgr->unPinPage(file1, pageno, true));
+      }
+      ASSERT(bufMgr->getLatency().histogram(ALLOCPAGE).count == 0);
+      bufMgr->getLatency().enable(true);
+      for (i = 0; i < frames; i++) {
+	CALL(bufMgr->allocPage(file1, pageno, page));
+	CALL(bufMgr->unPinPage(file1, pageno, true));
+      }
+      // the new pages hit, the ones they replaced miss
+      for (i = 0; i < 2 * frames; i++) {
+	pageno = 1 + (i + frames) % (2 * frames);
+	CALL(bufMgr->readPage(file1, pageno, page));
+	CALL(bufMgr->unPinPage(file1, pageno, false));
+      }
+      BufLatency& latency = bufMgr->getLatency();
+      ASSERT(latency.histogram(ALLOCPAGE).count == frames);
+      ASSERT(latency.histogram(READMISS).count == frames);
+      ASSERT(latency.histogram(READHIT).count == frames);
+      ASSERT(latency.histogram(FILEREAD).count >= frames);
+      ASSERT(latency.histogram(FILEWRITE).count >= frames);
+      LatencyHistogram miss = latency.histogram(READMISS);
+      ASSERT(miss.percentile(50) <= miss.percentile(99));
+      ASSERT(miss.percentile(99) <= miss.max() && miss.max() > 0);
+      latency.dump(cout);
+
+      // pages read and written through the I/O engine are timed as well
+      latency.clear();
+      int batch[frames];
+      Page* pages[frames];
+      for (i = 0; i < frames; i++)
+	batch[i] = frames + 1 + i;
+      CALL(bufMgr->readPages(file1, batch, pages, frames));
+      CALL(bufMgr->unPinPages(file1, batch, frames, true));
+      ASSERT(latency.histogram(FILEREAD).count > 0);
+      ASSERT(latency.histogram(FILEWRITE).count == 0);
+      CALL(bufMgr->flushFile(file1));
+      ASSERT(latency.histogram(FILEWRITE).count > 0);
+      latency.enable(false);
+      latency.clear();
+      CALL(bufMgr->readPage(file1, 1, page));
+      CALL(bufMgr->unPinPage(file1, 1, false));
+      ASSERT(latency.histogram(READHIT).count + latency.histogram(READMISS).count == 0);
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nRecording a trace of the calls made...\n";
+    cout << "Expected Result: ";
+    cout << "The trace reads back as the calls made, files named before use.\n\n";
+
+    {
+      const int frames = 10;
+      bufMgr = new BufMgr(frames);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      // the first page of a file cannot be disposed of
+      CALL(bufMgr->allocPage(file1, pageno, page));
+      CALL(bufMgr->unPinPage(file1, pageno, false));
+      CALL(bufMgr->startTrace("test.trace"));
+      FAIL(bufMgr->startTrace("test.trace"));
+      CALL(bufMgr->allocPage(file1, pageno, page));
+      CALL(bufMgr->unPinPage(file1, pageno, true));
+      // calls that fail are not traced
+      FAIL(bufMgr->unPinPage(file1, pageno, true));
+      FAIL(bufMgr->disposePage(file1, 1));
+      int batch[2] = { pageno, pageno };
+      Page* pages[2];
+      CALL(bufMgr->readPages(file1, batch, pages, 2));
+      CALL(bufMgr->unPinPages(file1, batch, 2, false));
+      {
+	PageHandle handle;
+	CALL(bufMgr->readPage(file1, pageno, handle));
+	handle.markDirty();
+      }
+      int firstId = file1->getId();
+      CALL(db.closeFile(file1));
+      CALL(db.openFile("test.1", file1));
+      CALL(bufMgr->readPage(file1, pageno, page));
+      CALL(bufMgr->unPinPage(file1, pageno, false));
+      CALL(bufMgr->disposePage(file1, pageno));
+      CALL(bufMgr->stopTrace());
+      // what was not traced is not in the trace
+      CALL(bufMgr->readPage(file1, 1, page));
+      CALL(bufMgr->unPinPage(file1, 1, false));
+
+      struct { int op, flags; } expected[] = {
+	{ TRACENAME, 0 }, { TRACEALLOC, 0 }, { TRACEUNPIN, TRACEDIRTY },
+	{ TRACEREAD, 0 }, { TRACEREAD, 0 }, { TRACEUNPIN, 0 }, { TRACEUNPIN, 0 },
+	{ TRACEREAD, 0 }, { TRACEUNPIN, TRACEDIRTY }, { TRACEFLUSH, 0 },
+	{ TRACENAME, 0 }, { TRACEREAD, 0 }, { TRACEUNPIN, 0 },
+	{ TRACEDISPOSE, 0 }
+      };
+      const int nexpected = sizeof expected / sizeof expected[0];
+      TraceReader reader;
+      CALL(reader.open("test.trace"));
+      TraceRecord rec;
+      string name;
+      for (i = 0; i < nexpected; i++) {
+	ASSERT(reader.next(rec, name));
+	ASSERT(rec.op == expected[i].op && rec.flags == expected[i].flags);
+	// the file is named again under its new id when reopened
+	ASSERT((int) rec.file == (i < 10 ? firstId : file1->getId()));
+	if (rec.op == TRACENAME) {
+	  ASSERT(name == "test.1");
+	} else if (rec.op != TRACEFLUSH) {
+	  ASSERT(rec.pageNo == pageno);
+	}
+      }
+      ASSERT(!reader.next(rec, name));
+      unlink("test.trace");
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nRecording a trace of several threads...\n";
+    cout << "Expected Result: ";
+    cout << "Every call of every thread is in the trace, each thread's in order.\n\n";
+
+    {
+      const int threads = 4, pages = 50, rounds = 40;
+      bufMgr = new BufMgr(threads * pages);
+      File* files[threads];
+      for (int t = 0; t < threads; t++) {
+	char name[32];
+	sprintf(name, "test.%d", t + 1);
+	CALL(db.createFile(name));
+	CALL(db.openFile(name, files[t]));
+	for (i = 0; i < pages; i++) {
+	  CALL(bufMgr->allocPage(files[t], pageno, page));
+	  CALL(bufMgr->unPinPage(files[t], pageno, true));
+	}
+      }
+      CALL(bufMgr->startTrace("test.trace"));
+      bool failed = false;
+      vector<thread> readers;
+      for (int t = 0; t < threads; t++)
+	readers.push_back(thread(tracedReader, files[t], pages, rounds,
+				 &failed));
+      for (int t = 0; t < threads; t++)
+	readers[t].join();
+      CALL(bufMgr->stopTrace());
+      ASSERT(!failed);
+
+      // per file the reads and unpins alternate, pages in turn
+      TraceReader reader;
+      CALL(reader.open("test.trace"));
+      TraceRecord rec;
+      string name;
+      vector<int> calls(threads, 0);
+      int records = 0;
+      while (reader.next(rec, name)) {
+	ASSERT(rec.seq == (uint64_t) records);
+	records++;
+	int t = 0;
+	while (t < threads && files[t]->getId() != (int) rec.file)
+	  t++;
+	ASSERT(t < threads);
+	if (rec.op == TRACENAME) {
+	  ASSERT(calls[t] == 0 && name == files[t]->getName());
+	  continue;
+	}
+	ASSERT(rec.op == (calls[t] % 2 ? TRACEUNPIN : TRACEREAD));
+	ASSERT(rec.pageNo == 1 + calls[t] / 2 % pages);
+	calls[t]++;
+      }
+      for (int t = 0; t < threads; t++)
+	ASSERT(calls[t] == 2 * pages * rounds);
+      ASSERT(records == threads * (2 * pages * rounds + 1));
+      unlink("test.trace");
+      for (int t = 0; t < threads; t++) {
+	char name[32];
+	sprintf(name, "test.%d", t + 1);
+	CALL(db.closeFile(files[t]));
+	CALL(db.destroyFile(name));
+      }
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nGrowing and shrinking the pool while it is in use...\n";
+    cout << "Expected Result: ";
+    cout << "Pages stay cached when it grows, dirty ones are written back when it\n"
+	 << "shrinks, and readers see the right pages throughout.\n\n";
+
+    {
+      const int frames = 20, pages = 60;
+      for (int k = CLOCK; k <= CLOCKPRO; k++) {
+	bufMgr = new BufMgr(frames, BUFPARTITIONS, (ReplPolicy) k, 0, 4 * frames);
+	ASSERT(bufMgr->getNumBufs() == frames);
+	ASSERT(bufMgr->getMaxBufs() == 4 * frames);
+	CALL(db.createFile("test.1"));
+	CALL(db.openFile("test.1", file1));
+	for (i = 0; i < pages; i++) {
+	  CALL(bufMgr->allocPage(file1, pageno, page));
+	  sprintf((char*)page, "test.1 Page %d %7.1f", pageno, (float)pageno);
+	  CALL(bufMgr->unPinPage(file1, pageno, true));
+	}
+	CALL(bufMgr->flushFile(file1));
+	for (i = 1; i <= frames; i++) {
+	  CALL(bufMgr->readPage(file1, i, page));
+	  CALL(bufMgr->unPinPage(file1, i, false));
+	}
+	FAIL(bufMgr->resize(0));
+	FAIL(bufMgr->resize(4 * frames + 1));
+
+	// the pages read stay, and all of the file fits now
+	bufMgr->clearBufStats();
+	CALL(bufMgr->resize(pages));
+	for (i = 1; i <= frames; i++) {
+	  CALL(bufMgr->readPage(file1, i, page));
+	  CALL(bufMgr->unPinPage(file1, i, false));
+	}
+	ASSERT(bufMgr->getBufStats().diskreads == 0);
+	for (int pass = 0; pass < 2; pass++)
+	  for (i = 1; i <= pages; i++) {
+	    CALL(bufMgr->readPage(file1, i, page));
+	    CALL(bufMgr->unPinPage(file1, i, true));
+	  }
+	ASSERT(bufMgr->getBufStats().diskreads == pages - frames);
+
+	// the pages of the frames given up are written back
+	CALL(bufMgr->resize(frames / 2));
+	ASSERT(bufMgr->getNumBufs() == frames / 2);
+	ASSERT(bufMgr->getBufStats().diskwrites >= pages - frames / 2);
+	for (i = 1; i <= frames / 2; i++)
+	  CALL(bufMgr->readPage(file1, i, page));
+	FAIL(bufMgr->readPage(file1, frames / 2 + 1, page));
+	for (i = 1; i <= frames / 2; i++)
+	  CALL(bufMgr->unPinPage(file1, i, false));
+
+	// readers go on while the pool changes size under them
+	atomic<bool> stop(false);
+	bool failed[4] = { false };
+	vector<thread> readers;
+	for (i = 0; i < 4; i++)
+	  readers.push_back(thread(resizeReader, file1, pages, i + 1, &stop,
+				   &failed[i]));
+	const int sizes[] = { 40, 8, 80, 5, 30, 60, 12 };
+	for (int round = 0; round < 3; round++)
+	  for (int n = 0; n < 7; n++) {
+	    CALL(bufMgr->resize(sizes[n]));
+	    this_thread::sleep_for(chrono::milliseconds(1));
+	  }
+	stop = true;
+	for (i = 0; i < 4; i++) {
+	  readers[i].join();
+	  ASSERT(!failed[i]);
+	}
+	CALL(db.closeFile(file1));
+	CALL(db.destroyFile("test.1"));
+	delete bufMgr;
+      }
+
+      // a pinned page in the way keeps the pool as it is
+      bufMgr = new BufMgr(4);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      for (i = 0; i < 4; i++) {
+	CALL(bufMgr->allocPage(file1, pageno, page));
+	CALL(bufMgr->unPinPage(file1, pageno, true));
+      }
+      for (i = 1; i <= 4; i++)
+	CALL(bufMgr->readPage(file1, i, page));
+      FAIL(status = bufMgr->resize(2));
+      ASSERT(status == PAGEPINNED && bufMgr->getNumBufs() == 4);
+      for (i = 1; i <= 4; i++)
+	CALL(bufMgr->unPinPage(file1, i, false));
+      CALL(bufMgr->resize(2));
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nEstimating hit ratios at other pool sizes...\n";
+    cout << "Expected Result: ";
+    cout << "Loops hit once the pool holds them, sampling keeps the estimates.\n\n";
+
+    {
+      // loops over 100 and 300 pages, as many references each
+      BufCurve small, large;
+      small.enable(true);
+      large.enable(true);
+      for (i = 0; i < 3000; i++) {
+	small.record(((PageId) 1 << 32) | (1 + i % 100));
+	large.record(((PageId) 2 << 32) | (1 + i % 300));
+      }
+      ASSERT(small.hitRatio(90) == 0);
+      ASSERT(small.hitRatio(100) > 0.96 && small.hitRatio(1000) > 0.96);
+      ASSERT(large.hitRatio(280) == 0 && large.hitRatio(304) > 0.89);
+      ASSERT(small.references() == 3000);
+      int size = small.recommend(1000);
+      ASSERT(size > 90 && size <= 100);
+      vector<const BufCurve*> curves;
+      curves.push_back(&small);
+      curves.push_back(&large);
+      vector<int> sizes;
+      BufCurve::divide(curves, 400, 10, sizes);
+      ASSERT(sizes[0] >= 100 && sizes[1] >= 300);
+      BufCurve::divide(curves, 250, 10, sizes);
+      ASSERT(sizes[0] >= 100 && sizes[0] + sizes[1] == 250);
+      small.dump(cout, 200, 4);
+
+      // uniform references to more pages than are sampled
+      BufCurve curve(1000);
+      curve.enable(true);
+      unsigned int state = 1;
+      for (i = 0; i < 1000000; i++) {
+	state = state * 1103515245 + 12345;
+	curve.record(((PageId) 1 << 32) | (1 + (state >> 8) % 100000));
+      }
+      cout << "uniform over 100000 pages: hit ratio at 50000 frames "
+	   << curve.hitRatio(50000) << endl;
+      ASSERT(curve.hitRatio(50000) > 0.40 && curve.hitRatio(50000) < 0.50);
+      ASSERT(curve.references() > 900000 && curve.references() < 1100000);
+      curve.clear();
+      ASSERT(curve.references() == 0 && curve.hitRatio(100) == 0);
+
+      // a pool sizes itself to the pages it loops over
+      bufMgr = new BufMgr(50, BUFPARTITIONS, CLOCK, 0, 400);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      for (i = 0; i < 120; i++) {
+	CALL(bufMgr->allocPage(file1, pageno, page));
+	CALL(bufMgr->unPinPage(file1, pageno, true));
+      }
+      CALL(bufMgr->autoSize());
+      ASSERT(bufMgr->getNumBufs() == 50);
+      bufMgr->getCurve().enable(true);
+      for (i = 0; i < 2000; i++) {
+	CALL(bufMgr->readPage(file1, 1 + i % 120, page));
+	CALL(bufMgr->unPinPage(file1, 1 + i % 120, false));
+      }
+      CALL(bufMgr->autoSize());
+      ASSERT(bufMgr->getNumBufs() > 110 && bufMgr->getNumBufs() <= 120);
+
+      // threads reading the same missing pages with readPages(), which
+      // leaves the pages another thread entered first to readPage(),
+      // record every page once
+      bufMgr->getCurve().clear();
+      for (int round = 0; round < 20; round++) {
+	CALL(bufMgr->flushFile(file1));
+	bool failed[4] = { false };
+	vector<thread> readers;
+	for (i = 0; i < 4; i++)
+	  readers.push_back(thread(batchReader, file1, 40, &failed[i]));
+	for (i = 0; i < 4; i++) {
+	  readers[i].join();
+	  ASSERT(!failed[i]);
+	}
+      }
+      ASSERT(bufMgr->getCurve().references() == 20 * 4 * 40);
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nAllocating pages with the file header kept in memory...\n";
+    cout << "Expected Result: ";
+    cout << "No reads, and writes only of pages put on the free list; the header\n"
+	 << "reaches the file when it is flushed.\n\n";
+
+    {
+      bufMgr = new BufMgr(10);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      BufLatency& latency = bufMgr->getLatency();
+      file1->setLatency(&latency);
+      latency.enable(true);
+      latency.clear();
+      for (i = 0; i < 50; i++)
+	CALL(file1->allocatePage(pageno));
+      CALL(file1->disposePage(20));
+      CALL(file1->disposePage(30));
+      ASSERT(latency.histogram(FILEREAD).count == 0);
+      ASSERT(latency.histogram(FILEWRITE).count == 2);
+      CALL(file1->getFirstPage(pageno));
+      ASSERT(pageno == 1);
+
+      // page 0 of the file still says what it did after create
+      int fd = open("test.1", O_RDONLY);
+      ASSERT(fd >= 0);
+      DBPage onDisk;
+      ASSERT(pread(fd, &onDisk, sizeof onDisk, 0) == sizeof onDisk);
+      ASSERT(onDisk.numPages == 1 && onDisk.firstPage == -1);
+      CALL(bufMgr->flushFile(file1));
+      ASSERT(pread(fd, &onDisk, sizeof onDisk, 0) == sizeof onDisk);
+      ASSERT(onDisk.numPages == 51 && onDisk.firstPage == 1);
+      ASSERT(onDisk.nextFree == 30);
+
+      // the free list is used first, and survives closing and opening
+      CALL(file1->allocatePage(pageno));
+      ASSERT(pageno == 30);
+      CALL(db.closeFile(file1));
+      ASSERT(pread(fd, &onDisk, sizeof onDisk, 0) == sizeof onDisk);
+      ASSERT(onDisk.nextFree == 20);
+      close(fd);
+      CALL(db.openFile("test.1", file1));
+      CALL(file1->allocatePage(pageno));
+      ASSERT(pageno == 20);
+      CALL(file1->allocatePage(pageno));
+      ASSERT(pageno == 51);
+      latency.enable(false);
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nAllocating pages of a file with free-space bitmaps...\n";
+    cout << "Expected Result: ";
+    cout << "Pages are allocated and disposed of without I/O, runs of pages\n"
+	 << "come from the lowest free pages, and bitmap pages are never handed out.\n\n";
+
+    {
+      bufMgr = new BufMgr(10);
+      CALL(db.createFile("test.1", FREEBITMAP));
+      CALL(db.openFile("test.1", file1));
+      for (i = 0; i < 20; i++) {
+	CALL(file1->allocatePage(pageno));
+	ASSERT(pageno == i + 2);
+      }
+      BufLatency& latency = bufMgr->getLatency();
+      file1->setLatency(&latency);
+      latency.enable(true);
+      latency.clear();
+      CALL(file1->disposePage(5));
+      CALL(file1->disposePage(7));
+      CALL(file1->disposePage(8));
+      CALL(file1->disposePage(9));
+      ASSERT(file1->disposePage(8) == BADPAGENO);
+      ASSERT(file1->disposePage(1) == BADPAGENO);
+      ASSERT(file1->disposePage(2) == BADPAGENO);
+      CALL(file1->allocatePages(3, pageno));
+      ASSERT(pageno == 7);
+      CALL(file1->allocatePage(pageno));
+      ASSERT(pageno == 5);
+      ASSERT(latency.histogram(FILEREAD).count == 0);
+      ASSERT(latency.histogram(FILEWRITE).count == 0);
+      latency.enable(false);
+
+      // a run that would take in the second bitmap, page BITMAPPAGES,
+      // starts after it
+      CALL(file1->allocatePages(BITMAPPAGES - 100, pageno));
+      ASSERT(pageno == 22);
+      CALL(file1->allocatePages(200, pageno));
+      ASSERT(pageno == BITMAPPAGES + 1);
+      ASSERT(file1->disposePage(BITMAPPAGES) == BADPAGENO);
+      ASSERT(file1->allocatePages(BITMAPPAGES, pageno) == BADPAGENO);
+      CALL(file1->disposePage(100));
+
+      // the bitmaps survive closing and opening
+      CALL(db.closeFile(file1));
+      CALL(db.openFile("test.1", file1));
+      CALL(file1->allocatePage(pageno));
+      ASSERT(pageno == 100);
+      CALL(file1->allocatePages(50, pageno));
+      ASSERT(pageno == BITMAPPAGES - 78);
+      CALL(file1->allocatePage(pageno));
+      ASSERT(pageno == BITMAPPAGES - 28);
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nAllocating runs of pages...\n";
+    cout << "Expected Result: ";
+    cout << "The pages come pinned and in a row, the file grows in large steps\n"
+	 << "without writes, and shrinks back to its pages when closed.\n\n";
+
+    {
+      bufMgr = new BufMgr(20);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      BufLatency& latency = bufMgr->getLatency();
+      file1->setLatency(&latency);
+      latency.enable(true);
+      latency.clear();
+      Page* pages[20];
+      int pageNos[20];
+      CALL(bufMgr->allocPages(file1, 8, pageno, pages));
+      ASSERT(pageno == 1);
+      for (i = 0; i < 8; i++) {
+	sprintf((char*)pages[i], "test.1 Page %d %7.1f", pageno + i,
+		(float)(pageno + i));
+	pageNos[i] = pageno + i;
+      }
+      CALL(bufMgr->unPinPages(file1, pageNos, 8, true));
+      CALL(bufMgr->allocPages(file1, 12, pageno, pages));
+      ASSERT(pageno == 9);
+      ASSERT(latency.histogram(FILEWRITE).count == 0);
+      latency.enable(false);
+      // 12 pages pinned leave room for 8, and the file is not changed
+      ASSERT(bufMgr->allocPages(file1, 9, pageno, pages) == BUFFEREXCEEDED);
+      ASSERT(bufMgr->allocPages(file1, 21, pageno, pages) == BUFFEREXCEEDED);
+      for (i = 0; i < 12; i++)
+	pageNos[i] = 9 + i;
+      CALL(bufMgr->unPinPages(file1, pageNos, 12, false));
+
+      struct stat st;
+      ASSERT(stat("test.1", &st) == 0);
+      ASSERT(st.st_size >= (FILEGROWTH + 1) * PAGESIZE);
+      CALL(db.closeFile(file1));
+      ASSERT(stat("test.1", &st) == 0);
+      ASSERT(st.st_size == 21 * PAGESIZE);
+      CALL(db.openFile("test.1", file1));
+      for (i = 1; i <= 8; i++) {
+	CALL(bufMgr->readPage(file1, i, page));
+	sprintf((char*)&cmp, "test.1 Page %d %7.1f", i, (float)i);
+	ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+	CALL(bufMgr->unPinPage(file1, i, false));
+      }
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+
+      // a FREEBITMAP file hands out a run of disposed pages again
+      CALL(db.createFile("test.1", FREEBITMAP));
+      CALL(db.openFile("test.1", file1));
+      CALL(bufMgr->allocPages(file1, 10, pageno, pages));
+      ASSERT(pageno == 2);
+      for (i = 0; i < 10; i++)
+	pageNos[i] = pageno + i;
+      CALL(bufMgr->unPinPages(file1, pageNos, 10, true));
+      for (i = 5; i < 8; i++)
+	CALL(bufMgr->disposePage(file1, i));
+      CALL(bufMgr->allocPages(file1, 4, pageno, pages));
+      ASSERT(pageno == 12);
+      for (i = 0; i < 4; i++)
+	CALL(bufMgr->unPinPage(file1, 12 + i, false));
+      CALL(bufMgr->allocPages(file1, 3, pageno, pages));
+      ASSERT(pageno == 5);
+      for (i = 0; i < 3; i++)
+	CALL(bufMgr->unPinPage(file1, 5 + i, false));
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
+    cout << "\nAllocating pages without reading them...\n";
+    cout << "Expected Result: ";
+    cout << "New pages are zero and cost no I/O until they are written back.\n\n";
+
+    {
+      bufMgr = new BufMgr(10);
+      CALL(db.createFile("test.1"));
+      CALL(db.openFile("test.1", file1));
+      BufLatency& latency = bufMgr->getLatency();
+      file1->setLatency(&latency);
+      latency.enable(true);
+      latency.clear();
+      for (i = 0; i < 5; i++) {
+	CALL(bufMgr->allocPage(file1, pageno, page));
+	memset(&cmp, 0, sizeof cmp);
+	ASSERT(memcmp(page, &cmp, sizeof cmp) == 0);
+	sprintf((char*)page, "test.1 Page %d %7.1f", pageno, (float)pageno);
+	CALL(bufMgr->unPinPage(file1, pageno, false));
+      }
+      ASSERT(latency.histogram(FILEREAD).count == 0);
+      ASSERT(latency.histogram(FILEWRITE).count == 0);
+      ASSERT(bufMgr->getBufStats().diskreads == 0);
+      ASSERT(bufMgr->getBufStats().diskwrites == 0);
+      latency.enable(false);
+
+      // the pages are dirty though unpinned clean, and reach the file
+      CALL(bufMgr->flushFile(file1));
+      ASSERT(bufMgr->getBufStats().diskwrites == 5);
+      CALL(db.closeFile(file1));
+      CALL(db.openFile("test.1", file1));
+      for (i = 1; i <= 5; i++) {
+	CALL(bufMgr->readPage(file1, i, page));
+	sprintf((char*)&cmp, "test.1 Page %d %7.1f", i, (float)i);
+	ASSERT(memcmp(page, &cmp, strlen((char*)&cmp)) == 0);
+	CALL(bufMgr->unPinPage(file1, i, false));
+      }
+
+      // pages 2 and 4 are written with 1, 3 and 5 but are not counted
+      for (i = 1; i <= 5; i += 2) {
+	CALL(bufMgr->readPage(file1, i, page));
+	CALL(bufMgr->unPinPage(file1, i, true));
+      }
+      bufMgr->clearBufStats();
+      CALL(bufMgr->flushFile(file1));
+      ASSERT(bufMgr->getBufStats().diskwrites == 3);
+      CALL(db.closeFile(file1));
+      CALL(db.destroyFile("test.1"));
+      delete bufMgr;
+    }
+
+    cout << "Test passed" <<endl<<endl;
+
     cout << endl << "Passed all tests." << endl;
 
     return (1);
@@ -0,0 +1,372 @@
+// YCSB-style page access workloads on the buffer manager.
+//
+// Threads read pages of one file through a shared BufMgr, each access a
+// readPage() and unPinPage() pair, for a fixed time, and the run prints
+// the accesses per second, the pool's hit ratio and percentiles of the
+// access latency.  One run is made for every combination of thread count
+// and pool size given, which gives scaling curves in one go.
+//
+// Access patterns (-d):
+//   uniform    every page alike
+//   zipf       Zipfian with exponent -s (YCSB's scrambled Zipfian), so the
+//              popular pages are spread over the file
+//   hotset     80% of the accesses to the first -h of the pages
+//   scan       every thread reads the file in order, from its own start
+//   mixed      zipf, with a scan of 64 pages instead of one access in 20
+//
+// A fraction -w of the accesses dirty the page.  Pages hold their page
+// number, which every access checks.  -T records the timed part of the
+// first run in a trace file, for replay.  -c records the miss-ratio
+// curve of the timed part of every run (see BufCurve) and prints its hit
+// ratio at that many pool sizes up to the size of the file, as lines
+//   # curve  frames  hit_ratio
+// after the line of the run.
+//
+// usage: workload [-d pattern] [-t threads,...] [-r poolRatio,...]
+//                 [-p pages] [-w writeFraction] [-s theta] [-h hotFraction]
+//                 [-m millisPerRun] [-P policy] [-T traceFile] [-c points]
+//
+// The output is tab separated, a header line and then one line per run:
+//   pattern  policy  threads  frames  pages  ops  ops_per_s  hit_ratio
+//   p50_us  p99_us  p999_us
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include "page.h"
+#include "buf.h"
+#include "bufPolicy.h"
+
+BufMgr*     bufMgr;
+
+static const char* NAME = "workload.db";
+
+enum Pattern { UNIFORM, ZIPF, HOTSET, SCAN, MIXED };
+static const char* patterns[] = { "uniform", "zipf", "hotset", "scan", "mixed" };
+
+static Pattern pattern = ZIPF;
+static int pages = 65536;
+static double writes = 0.0;
+static double theta = 0.99;
+static double hot = 0.2;
+static int millis = 1000;
+static const char* traceFile = NULL;
+static int curvePoints = 0;
+
+static File* file;
+static atomic<bool> stop;
+static atomic<bool> failed;
+
+// splitmix64, one per thread
+struct Random
+{
+  uint64_t state;
+
+  Random(const uint64_t seed) : state(seed) {}
+  uint64_t next()
+  {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+  // uniform in [0, 1)
+  double real() { return (next() >> 11) * (1.0 / (1ULL << 53)); }
+};
+
+// Zipfian ranks 0 to n - 1, as Gray et al., "Quickly generating
+// billion-record synthetic databases", and YCSB compute them
+class Zipf
+{
+  uint64_t n;
+  double theta, alpha, zetan, eta;
+
+  static double zeta(const uint64_t n, const double theta)
+  {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++)
+      sum += 1 / pow((double) i, theta);
+    return sum;
+  }
+
+public:
+  Zipf(const uint64_t n, const double theta) : n(n), theta(theta)
+  {
+    alpha = 1 / (1 - theta);
+    zetan = zeta(n, theta);
+    eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / zetan);
+  }
+  uint64_t next(Random& random) const
+  {
+    double u = random.real();
+    double uz = u * zetan;
+    if (uz < 1)
+      return 0;
+    if (uz < 1 + pow(0.5, theta))
+      return 1;
+    uint64_t rank = (uint64_t) (n * pow(eta * u - eta + 1, alpha));
+    return min(rank, n - 1);
+  }
+};
+
+static Zipf* zipf;
+
+// the page for a Zipfian rank: FNV-1a of the rank, so that the popular
+// pages are not the first ones of the file
+static int scrambled(const uint64_t rank)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (int b = 0; b < 8; b++) {
+    h ^= (rank >> (8 * b)) & 0xff;
+    h *= 0x100000001b3ULL;
+  }
+  return 1 + h % pages;
+}
+
+// one readPage()/unPinPage() pair; false on an error or a wrong page
+static bool touch(const int pageNo, const bool dirty)
+{
+  Page* page;
+  if (bufMgr->readPage(file, pageNo, page) != OK)
+    return false;
+  bool right = *(int*) page == pageNo;
+  if (dirty)
+    *(int*) page = pageNo;
+  return bufMgr->unPinPage(file, pageNo, dirty) == OK && right;
+}
+
+static uint64_t nanos()
+{
+  return chrono::duration_cast<chrono::nanoseconds>
+    (chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// accesses until stop is set; counts them and their latencies in *hist
+static void worker(const int seed, LatencyHistogram* hist)
+{
+  Random random(seed);
+  int cursor = 1 + random.next() % pages;
+  int scanLeft = 0;
+  while (!stop) {
+    int pageNo;
+    switch (pattern) {
+    case UNIFORM:
+      pageNo = 1 + random.next() % pages;
+      break;
+    case HOTSET: {
+      int hotPages = max(1, (int) (hot * pages));
+      if (random.real() < 0.8 || hotPages == pages)
+	pageNo = 1 + random.next() % hotPages;
+      else
+	pageNo = 1 + hotPages + random.next() % (pages - hotPages);
+      break;
+    }
+    case SCAN:
+      pageNo = cursor;
+      cursor = cursor % pages + 1;
+      break;
+    case MIXED:
+      if (scanLeft == 0 && random.next() % 20 == 0) {
+	cursor = scrambled(zipf->next(random));
+	scanLeft = 64;
+      }
+      if (scanLeft > 0) {
+	pageNo = cursor;
+	cursor = cursor % pages + 1;
+	scanLeft--;
+	break;
+      }
+      pageNo = scrambled(zipf->next(random));
+      break;
+    default:
+      pageNo = scrambled(zipf->next(random));
+    }
+    bool dirty = writes > 0 && random.real() < writes;
+    uint64_t start = nanos();
+    if (!touch(pageNo, dirty)) {
+      failed = true;
+      return;
+    }
+    uint64_t ns = nanos() - start;
+    hist->bucket[LatencyHistogram::bucketOf(ns)]++;
+    hist->count++;
+    hist->sum += ns;
+  }
+}
+
+// runs threads workers for millis, after a warm up of the same length
+static void run(const int threads, const int frames, const ReplPolicy policy)
+{
+  bufMgr = new BufMgr(frames, BUFPARTITIONS, policy);
+  vector<LatencyHistogram> hists(threads);
+  for (int timed = 0; timed < 2; timed++) {
+    vector<thread> workers;
+    stop = false;
+    bufMgr->clearMetrics();
+    bufMgr->getCurve().clear();
+    bufMgr->getCurve().enable(timed && curvePoints > 0);
+    if (timed && traceFile && bufMgr->startTrace(traceFile) != OK) {
+      cerr << "cannot write trace " << traceFile << endl;
+      exit(1);
+    }
+    for (int t = 0; t < threads; t++) {
+      hists[t] = LatencyHistogram();
+      workers.push_back(thread(worker, 1 + t + timed * threads, &hists[t]));
+    }
+    this_thread::sleep_for(chrono::milliseconds(millis));
+    stop = true;
+    for (int t = 0; t < threads; t++)
+      workers[t].join();
+  }
+  if (traceFile) {
+    bufMgr->stopTrace();
+    traceFile = NULL;
+  }
+  if (failed) {
+    cerr << "an access failed or read a wrong page" << endl;
+    exit(1);
+  }
+  LatencyHistogram all;
+  for (int t = 0; t < threads; t++) {
+    for (int b = 0; b < LATENCYBUCKETS; b++)
+      all.bucket[b] += hists[t].bucket[b];
+    all.count += hists[t].count;
+    all.sum += hists[t].sum;
+  }
+  BufMetrics::Snapshot snap = bufMgr->getMetrics().snapshot();
+  uint64_t hits = snap[0].count[HITS];
+  uint64_t misses = snap[0].count[MISSES];
+  cout << patterns[pattern] << "\t" << BufPolicy::name(policy) << "\t"
+       << threads << "\t" << frames << "\t" << pages << "\t" << all.count
+       << "\t" << (long) (all.count * 1000.0 / millis) << "\t" << fixed
+       << setprecision(4) << (hits + misses ? (double) hits / (hits + misses) : 0)
+       << setprecision(2) << "\t" << all.percentile(50) / 1000.0 << "\t"
+       << all.percentile(99) / 1000.0 << "\t" << all.percentile(99.9) / 1000.0
+       << endl;
+  for (int k = 1; k <= curvePoints; k++) {
+    int size = max(1, (int) ((long) pages * k / curvePoints));
+    cout << "# curve\t" << size << "\t" << setprecision(4)
+	 << bufMgr->getCurve().hitRatio(size)
+	 << endl;
+  }
+  Status status = bufMgr->flushFile(file);
+  if (status != OK) {
+    Error().print(status);
+    exit(1);
+  }
+  delete bufMgr;
+  bufMgr = NULL;
+}
+
+// a comma separated list of numbers
+static bool parseList(const char* arg, vector<double>& values)
+{
+  values.clear();
+  istringstream in(arg);
+  string item;
+  while (getline(in, item, ',')) {
+    char* end;
+    double v = strtod(item.c_str(), &end);
+    if (item.empty() || *end || v <= 0)
+      return false;
+    values.push_back(v);
+  }
+  return !values.empty();
+}
+
+static int usage()
+{
+  cerr << "usage: workload [-d pattern] [-t threads,...] [-r poolRatio,...]" << endl
+       << "                [-p pages] [-w writeFraction] [-s theta] [-h hotFraction]" << endl
+       << "                [-m millisPerRun] [-P policy] [-T traceFile] [-c points]" << endl
+       << "patterns: uniform zipf hotset scan mixed" << endl
+       << "policies: clock lruk 2q arc clockpro" << endl;
+  return 1;
+}
+
+int main(int argc, char** argv)
+{
+  vector<double> threads(1, 1), ratios(1, 0.1);
+  ReplPolicy policy = CLOCK;
+  int opt;
+  while ((opt = getopt(argc, argv, "d:t:r:p:w:s:h:m:P:T:c:")) != -1) {
+    bool ok = true;
+    switch (opt) {
+    case 'd': {
+      int p = 0;
+      while (p < 5 && string(patterns[p]) != optarg)
+	p++;
+      ok = p < 5;
+      pattern = (Pattern) p;
+      break;
+    }
+    case 't': ok = parseList(optarg, threads); break;
+    case 'r': ok = parseList(optarg, ratios); break;
+    case 'p': ok = (pages = atoi(optarg)) > 0; break;
+    case 'w': writes = atof(optarg); ok = writes >= 0 && writes <= 1; break;
+    case 's': theta = atof(optarg); ok = theta > 0 && theta < 1; break;
+    case 'h': hot = atof(optarg); ok = hot > 0 && hot <= 1; break;
+    case 'm': ok = (millis = atoi(optarg)) > 0; break;
+    case 'T': traceFile = optarg; break;
+    case 'c': ok = (curvePoints = atoi(optarg)) > 0; break;
+    case 'P': {
+      int k = 0;
+      while (k <= CLOCKPRO && string(BufPolicy::name((ReplPolicy) k)) != optarg)
+	k++;
+      ok = k <= CLOCKPRO;
+      policy = (ReplPolicy) k;
+      break;
+    }
+    default: ok = false;
+    }
+    if (!ok)
+      return usage();
+  }
+  if (optind != argc)
+    return usage();
+
+  DB db;
+  Status status;
+  if (access(NAME, F_OK) == 0)
+    (void)db.destroyFile(NAME);
+  if ((status = db.createFile(NAME)) != OK ||
+      (status = db.openFile(NAME, file)) != OK) {
+    Error().print(status);
+    return 1;
+  }
+  static Page page;
+  memset(&page, 0, sizeof page);
+  for (int p = 0; p < pages; p++) {
+    int pageNo;
+    if ((status = file->allocatePage(pageNo)) != OK ||
+	(*(int*) &page = pageNo,
+	 (status = file->writePage(pageNo, &page)) != OK)) {
+      Error().print(status);
+      return 1;
+    }
+  }
+  if (pattern == ZIPF || pattern == MIXED)
+    zipf = new Zipf(pages, theta);
+
+  cout << "# pattern=" << patterns[pattern] << " pages=" << pages
+       << " writes=" << writes << " theta=" << theta << " hot=" << hot
+       << " millis=" << millis << endl;
+  cout << "pattern\tpolicy\tthreads\tframes\tpages\tops\tops_per_s\thit_ratio"
+       << "\tp50_us\tp99_us\tp999_us" << endl;
+  for (size_t r = 0; r < ratios.size(); r++)
+    for (size_t t = 0; t < threads.size(); t++)
+      run((int) threads[t], max(1, (int) (ratios[r] * pages)), policy);
+
+  delete zipf;
+  db.closeFile(file);
+  db.destroyFile(NAME);
+  return 0;
+}